@@ -0,0 +1,63 @@
+/*
+Name:        asyncEchoBot.ino
+Description: the echoBot example written with the asynchronous API:
+             the loop() function is never blocked waiting for the Telegram server,
+             so the onboard LED keeps blinking while the bot is working
+*/
+#include "CTBot.h"
+#include "Utilities.h" // for int64ToAscii() helper function
+CTBot myBot;
+
+String ssid  = "mySSID"    ; // REPLACE mySSID WITH YOUR WIFI SSID
+String pass  = "myPassword"; // REPLACE myPassword YOUR WIFI PASSWORD, IF ANY
+String token = "myToken"   ; // REPLACE myToken WITH YOUR TELEGRAM BOT TOKEN
+uint8_t led  = 2;            // the onboard ESP8266 LED
+
+uint32_t lastBlink = 0;
+
+// invoked by tick() for every received message
+void onMessage(TBMessage& msg) {
+	// forward it to the sender
+	myBot.sendMessageAsync(msg.sender.id, msg.text);
+}
+
+// invoked by tick() when a message is sent (or failed)
+void onMessageSent(int64_t id, bool result) {
+	if (!result)
+		Serial.println((String)"Unable to send the message to " + int64ToAscii(id));
+}
+
+void setup() {
+	// initialize the Serial
+	Serial.begin(115200);
+	Serial.println("Starting TelegramBot...");
+
+	// connect the ESP8266 to the desired access point
+	myBot.wifiConnect(ssid, pass);
+
+	// set the telegram bot token
+	myBot.setTelegramToken(token);
+
+	// reuse the connection: the (blocking) TLS handshake is done only when the link drops
+	myBot.useKeepAlive(true);
+
+	// set the callbacks
+	myBot.setMessageCallback(onMessage);
+	myBot.setSendMessageCallback(onMessageSent);
+
+	pinMode(led, OUTPUT);
+}
+
+void loop() {
+	// ask for new messages, if not already asked
+	myBot.beginGetUpdates();
+
+	// carry on the requests (at most 20 milliseconds)
+	myBot.tick();
+
+	// the application code keeps running
+	if (millis() - lastBlink > 250) {
+		digitalWrite(led, !digitalRead(led));
+		lastBlink = millis();
+	}
+}
@@ -0,0 +1,213 @@
+/*
+Name:        benchmark.ino
+Description: micro-benchmark of the string and JSON hot paths of the library.
+             No WiFi connection is needed: the Telegram server is replaced
+             by a fake transport that replays recorded getUpdates responses.
+             For every benchmark the time per byte (ns/byte), the free heap
+             lost after the run (leaks) and the lowest free heap seen during the
+             run (peak usage) are printed on the serial port
+*/
+#include "CTBot.h"
+#include "Utilities.h" // for URLEncodeMessage(), unicodeToUTF8() and int64ToAscii()
+CTBot myBot;
+
+#define ITERATIONS 20 // how many times every benchmark is repeated
+
+// the recorded getUpdates responses: the %TEXT% placeholder is replaced with the message text
+const char* messageUpdate = 
+	"{\"ok\":true,\"result\":[{\"update_id\":123456789,\"message\":{\"message_id\":42,"
+	"\"from\":{\"id\":987654321,\"is_bot\":false,\"first_name\":\"Stefano\",\"last_name\":\"Ledda\",\"username\":\"shurillu\",\"language_code\":\"it\"},"
+	"\"chat\":{\"id\":987654321,\"first_name\":\"Stefano\",\"last_name\":\"Ledda\",\"username\":\"shurillu\",\"type\":\"private\"},"
+	"\"date\":1600000000,\"text\":\"%TEXT%\"}}]}";
+const char* queryUpdate =
+	"{\"ok\":true,\"result\":[{\"update_id\":123456790,\"callback_query\":{\"id\":\"4382bfdwdsb323b2d9\","
+	"\"from\":{\"id\":987654321,\"is_bot\":false,\"first_name\":\"Stefano\",\"last_name\":\"Ledda\",\"username\":\"shurillu\",\"language_code\":\"it\"},"
+	"\"message\":{\"message_id\":43,\"from\":{\"id\":111111111,\"is_bot\":true,\"first_name\":\"myBot\",\"username\":\"myBot\"},"
+	"\"chat\":{\"id\":987654321,\"first_name\":\"Stefano\",\"type\":\"private\"},\"date\":1600000001,\"text\":\"%TEXT%\","
+	"\"reply_markup\":{\"inline_keyboard\":[[{\"text\":\"LIGHT ON\",\"callback_data\":\"lightOn\"},{\"text\":\"LIGHT OFF\",\"callback_data\":\"lightOff\"}]]}},"
+	"\"chat_instance\":\"-1234567890123456789\",\"data\":\"lightOn\"}}]}";
+
+// the corpus
+struct Sample {
+	const char* name;
+	String      text;     // the message text, as sent by the user
+	String      escaped;  // the message text, as escaped in the JSON response
+	const char* update;   // the recorded response
+};
+Sample corpus[4];
+
+// the lowest free heap seen by the fake transport
+uint32_t minFreeHeap;
+
+uint32_t getMaxBlock() {
+#if defined(ARDUINO_ARCH_ESP8266)
+	return ESP.getMaxFreeBlockSize();
+#else
+	return ESP.getMaxAllocHeap();
+#endif
+}
+
+void sampleHeap() {
+	uint32_t freeHeap = ESP.getFreeHeap();
+	if (freeHeap < minFreeHeap)
+		minFreeHeap = freeHeap;
+}
+
+// a fake Telegram server: every connection replays the same HTTP response from memory
+class ReplayClient : public Client {
+public:
+	void setBody(const String& body) {
+		m_response = (String)"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + 
+			body.length() + "\r\nConnection: close\r\n\r\n" + body;
+	}
+	int connect(IPAddress, uint16_t) override { m_position = 0; m_isConnected = true; return 1; }
+	int connect(const char*, uint16_t) override { m_position = 0; m_isConnected = true; return 1; }
+	size_t write(uint8_t) override { return 1; }
+	size_t write(const uint8_t*, size_t size) override { return size; }
+	int available() override { 
+		sampleHeap();
+		return m_isConnected ? m_response.length() - m_position : 0; 
+	}
+	int read() override {
+		if (available() <= 0)
+			return -1;
+		return (uint8_t)m_response[m_position++];
+	}
+	int read(uint8_t* buffer, size_t size) override {
+		size_t length = available();
+		if (length > size)
+			length = size;
+		memcpy(buffer, m_response.c_str() + m_position, length);
+		m_position += length;
+		return length;
+	}
+	int peek() override { return (available() > 0) ? (uint8_t)m_response[m_position] : -1; }
+	void flush() override {}
+	void stop() override { m_isConnected = false; }
+	uint8_t connected() override { return m_isConnected && (m_position < m_response.length()); }
+	operator bool() override { return m_isConnected; }
+private:
+	String   m_response;
+	uint32_t m_position{ 0 };
+	bool     m_isConnected{ false };
+};
+ReplayClient telegramServer;
+
+// the benchmark results
+uint32_t startTime;
+uint32_t startHeap;
+
+void beginBenchmark() {
+	minFreeHeap = startHeap = ESP.getFreeHeap();
+	startTime = micros();
+}
+
+void endBenchmark(const char* function, const char* sample, uint32_t bytes, uint32_t failures) {
+	uint32_t elapsed = micros() - startTime;
+	sampleHeap();
+	Serial.print(function);
+	Serial.print("\t");
+	Serial.print(sample);
+	Serial.print("\t");
+	Serial.print((uint32_t)(((uint64_t)elapsed * 1000) / (bytes * ITERATIONS)));
+	Serial.print(" ns/byte\t");
+	Serial.print((int32_t)(startHeap - ESP.getFreeHeap()));
+	Serial.print(" bytes lost\t");
+	Serial.print(startHeap - minFreeHeap);
+	Serial.print(" bytes peak\t");
+	Serial.print(getMaxBlock());
+	Serial.print(" max block\t");
+	Serial.print(failures);
+	Serial.println(" failures");
+}
+
+void benchmarkURLEncode(Sample& sample) {
+	beginBenchmark();
+	for (uint16_t i = 0; i < ITERATIONS; i++) {
+		String encoded = URLEncodeMessage(sample.text);
+		sampleHeap();
+	}
+	endBenchmark("URLEncodeMessage", sample.name, sample.text.length(), 0);
+}
+
+void benchmarkUnicodeToUTF8() {
+	const char* codes[] = { "\\u0041", "\\u00e8", "\\u20ac", "\\ud83d\\ude00" };
+	uint32_t failures = 0;
+	beginBenchmark();
+	for (uint16_t i = 0; i < ITERATIONS; i++) {
+		for (uint8_t j = 0; j < 4; j++) {
+			String utf8;
+			if (!unicodeToUTF8(codes[j], utf8))
+				failures++;
+			sampleHeap();
+		}
+	}
+	endBenchmark("unicodeToUTF8", "codes", 3 * 6 + 12, failures);
+}
+
+void benchmarkInt64ToAscii() {
+	int64_t values[] = { 0, 987654321, -1001234567890, 9223372036854775807LL };
+	beginBenchmark();
+	for (uint16_t i = 0; i < ITERATIONS; i++) {
+		for (uint8_t j = 0; j < 4; j++) {
+			String ascii = int64ToAscii(values[j]);
+			sampleHeap();
+		}
+	}
+	endBenchmark("int64ToAscii", "values", 4 * 8, 0);
+}
+
+void benchmarkGetNewMessage(Sample& sample, bool useUTF8) {
+	String body(sample.update);
+	body.replace("%TEXT%", sample.escaped);
+	telegramServer.setBody(body);
+	// the whole response is parsed: the time is per byte of the response
+	uint32_t failures = 0;
+	myBot.enableUTF8Encoding(useUTF8);
+	beginBenchmark();
+	for (uint16_t i = 0; i < ITERATIONS; i++) {
+		TBMessage msg;
+		if (!myBot.getNewMessage(msg))
+			failures++;
+	}
+	endBenchmark(useUTF8 ? "getNewMessage (UTF8)" : "getNewMessage", sample.name, body.length(), failures);
+}
+
+void setup() {
+	// initialize the Serial
+	Serial.begin(115200);
+	Serial.println("\nStarting benchmark...");
+
+	// build the corpus
+	corpus[0] = { "ascii", "Hello world! This is a plain ASCII message, 0123456789.", "", messageUpdate };
+	corpus[0].escaped = corpus[0].text;
+	corpus[1] = { "emoji", "", "", messageUpdate };
+	for (uint8_t i = 0; i < 16; i++) {
+		corpus[1].text    += "\xF0\x9F\x98\x80 ok \xE2\x82\xAC ";      // grinning face, euro sign
+		corpus[1].escaped += "\\ud83d\\ude00 ok \\u20ac ";
+	}
+	corpus[2] = { "4096 chars", "", "", messageUpdate };
+	corpus[2].text.reserve(4096);
+	while (corpus[2].text.length() < 4096)
+		corpus[2].text += "Lorem ipsum dolor sit amet. ";
+	corpus[2].text.remove(4096);
+	corpus[2].escaped = corpus[2].text;
+	corpus[3] = { "query", "Choose a button", "Choose a button", queryUpdate };
+
+	// replace the Telegram server with the fake one
+	myBot.setTransport(&telegramServer);
+	myBot.setTelegramToken("123456789:benchmark");
+
+	for (uint8_t i = 0; i < 4; i++)
+		benchmarkURLEncode(corpus[i]);
+	benchmarkUnicodeToUTF8();
+	benchmarkInt64ToAscii();
+	for (uint8_t i = 0; i < 4; i++) {
+		benchmarkGetNewMessage(corpus[i], false);
+		benchmarkGetNewMessage(corpus[i], true);
+	}
+	Serial.println("Done.");
+}
+
+void loop() {
+}
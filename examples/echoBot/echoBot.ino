@@ -22,6 +22,10 @@ void setup() {
 
 	// set the telegram bot token
 	myBot.setTelegramToken(token);
+
+	// long polling: getNewMessage waits up to 30 seconds for a new message
+	// and returns as soon as it arrives (no need to poll every 500 milliseconds)
+	myBot.setPollingTimeout(30);
 	
 	// check if all things are ok
 	if (myBot.testConnection())
@@ -38,7 +42,4 @@ void loop() {
 	if (myBot.getNewMessage(msg))
 		// ...forward it to the sender
 		myBot.sendMessage(msg.sender.id, msg.text);
-	 
-	// wait 500 milliseconds
-	delay(500);
 }
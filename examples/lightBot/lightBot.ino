@@ -30,6 +30,10 @@ void setup() {
 	// set the telegram bot token
 	myBot.setTelegramToken(token);
 
+	// long polling: getNewMessage waits up to 30 seconds for a new message
+	// and returns as soon as it arrives (no need to poll every 500 milliseconds)
+	myBot.setPollingTimeout(30);
+
 	// check if all things are ok
 	if (myBot.testConnection())
 		Serial.println("\ntestConnection OK");
@@ -64,6 +68,4 @@ void loop() {
 			myBot.sendMessage(msg.sender.id, reply);             // and send it
 		}
 	}
-	// wait 500 milliseconds
-	delay(500);
 }
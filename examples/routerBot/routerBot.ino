@@ -0,0 +1,94 @@
+/*
+Name:        routerBot.ino
+Description: the lightBot written with a command router:
+             1) the "/light on" and "/light off" commands turn on/off the onboard LED
+             2) the "/menu" command shows an inline keyboard that sends the
+                "light:on" and "light:off" callback queries, handled by the same router
+             3) any other message is returned by getNewMessage(): reply with the instructions
+*/
+#include "CTBot.h"
+CTBot myBot;
+CTBotRouter router;
+
+String ssid = "mySSID";     // REPLACE mySSID WITH YOUR WIFI SSID
+String pass = "myPassword"; // REPLACE myPassword YOUR WIFI PASSWORD, IF ANY
+String token = "myToken";   // REPLACE myToken WITH YOUR TELEGRAM BOT TOKEN
+uint8_t led = 2;            // the onboard ESP8266 LED.
+                            // If you have a NodeMCU you can use the BUILTIN_LED pin
+                            // (replace 2 with BUILTIN_LED)
+                            // ATTENTION: this led use inverted logic
+
+// the inline keyboard, stored in flash
+static const char lightKeyboard[] PROGMEM = CTBOT_STATIC_INLINE_KEYBOARD(
+	CTBOT_ROW(CTBOT_QUERY_BUTTON("LIGHT ON", "light:on"), CTBOT_QUERY_BUTTON("LIGHT OFF", "light:off")));
+
+// turn on/off the LED. Returns false if the argument is not "on" or "off"
+bool setLight(const char* args) {
+	if (strcasecmp(args, "on") == 0)
+		digitalWrite(led, LOW);  // turn on the LED (inverted logic!)
+	else if (strcasecmp(args, "off") == 0)
+		digitalWrite(led, HIGH); // turn off the LED (inverted logic!)
+	else
+		return false;
+	return true;
+}
+
+// "/light on", "/light off"
+void onLightCommand(TBMessage& msg, const char* args) {
+	if (setLight(args))
+		myBot.sendMessage(msg.sender.id, (String)"Light is now " + args);
+	else
+		myBot.sendMessage(msg.sender.id, "Usage: /light on or /light off");
+}
+
+// "/menu"
+void onMenuCommand(TBMessage& msg, const char*) {
+	myBot.sendMessage(msg.sender.id, "Light control", FPSTR(lightKeyboard));
+}
+
+// "light:on", "light:off" callback queries
+void onLightQuery(TBMessage& msg, const char* args) {
+	setLight(args);
+	myBot.endQuery(msg.callbackQueryID, (String)"Light is now " + args);
+}
+
+void setup() {
+	// initialize the Serial
+	Serial.begin(115200);
+	Serial.println("Starting TelegramBot...");
+
+	// connect the ESP8266 to the desired access point
+	myBot.wifiConnect(ssid, pass);
+
+	// set the telegram bot token
+	myBot.setTelegramToken(token);
+
+	// long polling: getNewMessage waits up to 30 seconds for a new message
+	myBot.setPollingTimeout(30);
+
+	// check if all things are ok
+	if (myBot.testConnection())
+		Serial.println("\ntestConnection OK");
+	else
+		Serial.println("\ntestConnection NOK");
+
+	// the routes: the handlers are called by getNewMessage()
+	// router.setBotName("myBotUsername"); // UNCOMMENT AND REPLACE WITH YOUR BOT USERNAME (for groups)
+	router.addCommand("/light", onLightCommand);
+	router.addCommand("/menu", onMenuCommand);
+	router.addQuery("light", onLightQuery);
+	myBot.setRouter(&router);
+
+	// set the pin connected to the LED to act as output pin
+	pinMode(led, OUTPUT);
+	digitalWrite(led, HIGH); // turn off the led (inverted logic!)
+}
+
+void loop() {
+	// a variable to store telegram message data
+	TBMessage msg;
+
+	// the commands are handled by the router: only the other messages are returned
+	if (myBot.getNewMessage(msg))
+		myBot.sendMessage(msg.sender.id, "Try /light on, /light off or /menu");
+}
@@ -0,0 +1,63 @@
+/*
+Name:        webhookBot.ino
+Description: the echoBot in webhook mode: the Telegram server POSTs every message to the
+             embedded webhook server, so no request is sent while nobody is talking.
+             The echo is put into the answer to the webhook request: no request at all.
+             Telegram delivers only to HTTPS URLs: a reverse proxy (i.e. nginx) must
+             terminate the TLS and forward the requests to http://<board IP>:8080/
+             The webhook server can be tested without Telegram (see examples/README.md):
+             curl -H "X-Telegram-Bot-Api-Secret-Token: mySecret" -d "<update JSON>" http://<board IP>:8080/
+*/
+#include "CTBot.h"
+CTBot myBot;
+
+String ssid   = "mySSID";     // REPLACE mySSID WITH YOUR WIFI SSID
+String pass   = "myPassword"; // REPLACE myPassword YOUR WIFI PASSWORD, IF ANY
+String token  = "myToken";    // REPLACE myToken WITH YOUR TELEGRAM BOT TOKEN
+String url    = "https://example.com/myBot"; // REPLACE WITH THE HTTPS URL OF YOUR REVERSE PROXY
+String secret = "mySecret";   // REPLACE mySecret WITH A RANDOM STRING (A-Z, a-z, 0-9, _ and -)
+uint16_t port = 8080;         // the port where the reverse proxy forwards the requests
+
+void setup() {
+	// initialize the Serial
+	Serial.begin(115200);
+	Serial.println("Starting TelegramBot...");
+
+	// connect the ESP8266 to the desired access point
+	myBot.wifiConnect(ssid, pass);
+
+	// set the telegram bot token
+	myBot.setTelegramToken(token);
+
+	// check if all things are ok
+	if (myBot.testConnection())
+		Serial.println("\ntestConnection OK");
+	else
+		Serial.println("\ntestConnection NOK");
+
+	// register the webhook: from now on the Telegram server POSTs the messages
+	if (myBot.setWebhook(url, secret))
+		Serial.println("setWebhook OK");
+	else
+		Serial.println("setWebhook NOK");
+
+	// start the embedded webhook server
+	myBot.startWebhookServer(port);
+	Serial.print("Webhook server listening on http://");
+	Serial.print(WiFi.localIP().toString());
+	Serial.print(":");
+	Serial.println(port);
+}
+
+void loop() {
+	// a variable to store telegram message data
+	TBMessage msg;
+
+	// no request to the Telegram server: getNewMessage only handles the pending webhook request (if any)
+	if (CTBotMessageText == myBot.getNewMessage(msg))
+		// echo the message back inside the answer to the webhook request (sent by the next getNewMessage)
+		myBot.replyMessage(msg.sender.id, msg.text);
+
+	// wait 50 milliseconds
+	delay(50);
+}
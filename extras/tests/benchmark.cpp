@@ -0,0 +1,8 @@
+// the benchmark example, built for the host: setup() runs once
+#include "../../examples/benchmark/benchmark.ino"
+
+int main()
+{
+	setup();
+	return 0;
+}
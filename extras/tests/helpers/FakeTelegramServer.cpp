@@ -0,0 +1,283 @@
+#include "FakeTelegramServer.h"
+
+typedef std::lock_guard<std::recursive_mutex> Lock;
+
+// a status 200 response with a Content-Length header
+static String makeResponse(const String& json)
+{
+	String response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: ";
+	response += json.length();
+	response += "\r\nConnection: keep-alive\r\n\r\n";
+	response += json;
+	return response;
+}
+
+void FakeTelegramServer::reply(const String& json)
+{
+	replyRaw(makeResponse(json));
+}
+
+void FakeTelegramServer::replyChunked(const String& json, size_t chunkSize)
+{
+	String response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n";
+	response += "Connection: keep-alive\r\n\r\n";
+	for (size_t position = 0; position < json.length(); position += chunkSize) {
+		String chunk = json.substring(position, position + chunkSize);
+		response += String(chunk.length(), HEX);
+		response += "\r\n";
+		response += chunk;
+		response += "\r\n";
+	}
+	response += "0\r\n\r\n";
+	replyRaw(response);
+}
+
+void FakeTelegramServer::replyRaw(const String& response)
+{
+	Lock lock(m_mutex);
+	m_responses.push_back({ ResponseData, response });
+}
+
+void FakeTelegramServer::replyNothing()
+{
+	Lock lock(m_mutex);
+	m_responses.push_back({ ResponseNothing, String() });
+}
+
+void FakeTelegramServer::replyClose()
+{
+	Lock lock(m_mutex);
+	m_responses.push_back({ ResponseClose, String() });
+}
+
+void FakeTelegramServer::setDefaultReply(const String& json)
+{
+	Lock lock(m_mutex);
+	m_defaultReply = json;
+}
+
+void FakeTelegramServer::holdAfter(size_t count)
+{
+	Lock lock(m_mutex);
+	m_holdAfter = count;
+}
+
+void FakeTelegramServer::release()
+{
+	Lock lock(m_mutex);
+	m_holdAfter = SIZE_MAX;
+}
+
+void FakeTelegramServer::setReachable(bool isReachable)
+{
+	Lock lock(m_mutex);
+	m_isReachable = isReachable;
+}
+
+void FakeTelegramServer::closeConnection()
+{
+	Lock lock(m_mutex);
+	m_isStale = m_isConnected;
+}
+
+void FakeTelegramServer::setRequestHook(std::function<void(size_t)> hook)
+{
+	Lock lock(m_mutex);
+	m_requestHook = hook;
+}
+
+uint32_t FakeTelegramServer::getConnectCount()
+{
+	Lock lock(m_mutex);
+	return m_connects;
+}
+
+String FakeTelegramServer::getConnectHost()
+{
+	Lock lock(m_mutex);
+	return m_connectHost;
+}
+
+size_t FakeTelegramServer::getRequestCount()
+{
+	Lock lock(m_mutex);
+	return m_requests.size();
+}
+
+String FakeTelegramServer::getRequest(size_t index)
+{
+	Lock lock(m_mutex);
+	return (index < m_requests.size()) ? m_requests[index].headers : String();
+}
+
+String FakeTelegramServer::getBody(size_t index)
+{
+	Lock lock(m_mutex);
+	return (index < m_requests.size()) ? m_requests[index].body : String();
+}
+
+int FakeTelegramServer::connect(IPAddress, uint16_t port)
+{
+	return connect("", port);
+}
+
+int FakeTelegramServer::connect(const char* host, uint16_t)
+{
+	Lock lock(m_mutex);
+	stop();
+	m_connectHost = host;
+	if (!m_isReachable)
+		return 0;
+	m_isConnected = true;
+	m_connects++;
+	return 1;
+}
+
+size_t FakeTelegramServer::write(uint8_t value)
+{
+	return write(&value, 1);
+}
+
+size_t FakeTelegramServer::write(const uint8_t* buffer, size_t size)
+{
+	size_t count;
+	std::function<void(size_t)> hook;
+	{
+		Lock lock(m_mutex);
+		noticeClose();
+		// a connection closed by the server: the write fails
+		if (!m_isConnected || m_isClosed)
+			return 0;
+		m_input.concat((const char*)buffer, size);
+		count = handleInput();
+		hook = m_requestHook;
+	}
+	// the hook can block, waiting for the test thread: it is invoked without holding the lock
+	if ((count > 0) && hook)
+		hook(count);
+	return size;
+}
+
+size_t FakeTelegramServer::handleInput()
+{
+	int headersEnd = m_input.indexOf("\r\n\r\n");
+	if (headersEnd < 0)
+		return 0;
+	String headers = m_input.substring(0, headersEnd + 4);
+	String lowered = headers;
+	lowered.toLowerCase();
+	size_t bodyLength = 0;
+	int position = lowered.indexOf("content-length:");
+	if (position >= 0)
+		bodyLength = lowered.substring(position + 15).toInt();
+	if (m_input.length() < headers.length() + bodyLength)
+		return 0;
+
+	m_requests.push_back({ headers, m_input.substring(headers.length(), headers.length() + bodyLength) });
+	m_input = m_input.substring(headers.length() + bodyLength);
+
+	Response response;
+	if (!m_responses.empty()) {
+		response = m_responses.front();
+		m_responses.pop_front();
+	} else if (m_defaultReply.length() > 0)
+		response = { ResponseData, makeResponse(m_defaultReply) };
+	else
+		response = { ResponseNothing, String() };
+
+	if (ResponseData == response.type) {
+		// drop the already read bytes
+		m_output = m_output.substring(m_outputPosition) + response.data;
+		m_outputPosition = 0;
+	} else if (ResponseClose == response.type)
+		m_isClosed = true;
+	return m_requests.size();
+}
+
+void FakeTelegramServer::noticeClose()
+{
+	if (m_isStale) {
+		m_isStale  = false;
+		m_isClosed = true;
+	}
+}
+
+size_t FakeTelegramServer::getReadable()
+{
+	noticeClose();
+	if (!m_isConnected)
+		return 0;
+	size_t readable = m_output.length() - m_outputPosition;
+	return (readable > m_holdAfter) ? m_holdAfter : readable;
+}
+
+int FakeTelegramServer::available()
+{
+	Lock lock(m_mutex);
+	return (int)getReadable();
+}
+
+int FakeTelegramServer::read()
+{
+	uint8_t value;
+	return (read(&value, 1) == 1) ? value : -1;
+}
+
+int FakeTelegramServer::read(uint8_t* buffer, size_t size)
+{
+	Lock lock(m_mutex);
+	size_t readable = getReadable();
+	if (0 == readable)
+		return -1;
+	if (size > readable)
+		size = readable;
+	memcpy(buffer, m_output.c_str() + m_outputPosition, size);
+	m_outputPosition += size;
+	if (m_holdAfter != SIZE_MAX)
+		m_holdAfter -= size;
+	return (int)size;
+}
+
+int FakeTelegramServer::peek()
+{
+	Lock lock(m_mutex);
+	return (getReadable() > 0) ? (uint8_t)m_output[m_outputPosition] : -1;
+}
+
+void FakeTelegramServer::stop()
+{
+	Lock lock(m_mutex);
+	// the unread bytes of the closed connection are lost
+	m_isConnected = false;
+	m_isClosed = false;
+	m_isStale = false;
+	m_input = "";
+	m_output = "";
+	m_outputPosition = 0;
+}
+
+uint8_t FakeTelegramServer::connected()
+{
+	Lock lock(m_mutex);
+	// as the cores: a connection closed by the server is still connected while there are bytes to read
+	if (!m_isConnected)
+		return 0;
+	return (!m_isClosed || (m_output.length() > m_outputPosition)) ? 1 : 0;
+}
+
+String makeTextUpdate(int32_t updateID, int64_t chatID, const String& text)
+{
+	String json = "{\"ok\":true,\"result\":[{\"update_id\":";
+	json += updateID;
+	json += ",\"message\":{\"message_id\":";
+	json += updateID;
+	json += ",\"from\":{\"id\":";
+	json += chatID;
+	json += ",\"is_bot\":false,\"first_name\":\"Test\",\"username\":\"tester\",\"language_code\":\"it\"}";
+	json += ",\"chat\":{\"id\":";
+	json += chatID;
+	json += ",\"type\":\"private\"},\"date\":1600000000,\"text\":\"";
+	json += text;
+	json += "\"}}]}";
+	return json;
+}
@@ -0,0 +1,164 @@
+#pragma once
+#ifndef FAKE_TELEGRAM_SERVER
+#define FAKE_TELEGRAM_SERVER
+
+#include <Arduino.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// an in-memory Telegram server, plugged in with CTBot::setTransport() (or CTBotSecureConnection::setTransport()).
+// Every request written by the library is recorded and answered with the next queued response.
+// It can be used by the background task thread and by the test thread at the same time
+class FakeTelegramServer : public Client
+{
+public:
+	// queue the answer of a request: status 200, the JSON body with a Content-Length header
+	// params
+	//   json: the response body
+	void reply(const String& json);
+
+	// queue the answer of a request: status 200, the JSON body with the chunked transfer encoding
+	// params
+	//   json     : the response body
+	//   chunkSize: the size of every chunk
+	void replyChunked(const String& json, size_t chunkSize);
+
+	// queue the answer of a request, as is
+	// params
+	//   response: the whole HTTP response (status line, headers and body)
+	void replyRaw(const String& response);
+
+	// queue a request that is received but never answered: the connection stays open
+	void replyNothing(void);
+
+	// queue a request that is received, then the connection is closed without any answer
+	void replyClose(void);
+
+	// the answer of the requests when no response is queued. Empty (default) -> no answer
+	// params
+	//   json: the response body
+	void setDefaultReply(const String& json);
+
+	// hold back the response bytes: only the first count unread bytes are available
+	// params
+	//   count: how many bytes can be read
+	void holdAfter(size_t count);
+
+	// make all the response bytes available
+	void release(void);
+
+	// make the connections fail
+	// params
+	//   isReachable: false -> connect() fails
+	void setReachable(bool isReachable);
+
+	// close the current connection from the server side (i.e. a kept alive connection timed out):
+	// the client sees it only when it writes or reads, connected() is still true until then
+	void closeConnection(void);
+
+	// set a function invoked (by the client thread) every time a whole request is received,
+	// before answering it
+	// params
+	//   hook: the function, the parameter is the number of requests received so far
+	void setRequestHook(std::function<void(size_t)> hook);
+
+	// get how many connections have been opened
+	// returns
+	//   the number of connections
+	uint32_t getConnectCount(void);
+
+	// get the host name of the last connection
+	// returns
+	//   the name passed to connect(), empty if connected by IP address
+	String getConnectHost(void);
+
+	// get how many requests have been received
+	// returns
+	//   the number of requests
+	size_t getRequestCount(void);
+
+	// get a received request
+	// params
+	//   index: the request, zero based
+	// returns
+	//   the request line and the headers
+	String getRequest(size_t index);
+
+	// get the body of a received request
+	// params
+	//   index: the request, zero based
+	// returns
+	//   the request body
+	String getBody(size_t index);
+
+	int connect(IPAddress ip, uint16_t port) override;
+	int connect(const char* host, uint16_t port) override;
+	size_t write(uint8_t value) override;
+	size_t write(const uint8_t* buffer, size_t size) override;
+	int available(void) override;
+	int read(void) override;
+	int read(uint8_t* buffer, size_t size) override;
+	int peek(void) override;
+	void flush(void) override {}
+	void stop(void) override;
+	uint8_t connected(void) override;
+	operator bool(void) override { return connected() != 0; }
+	using Print::write;
+
+private:
+	enum ResponseType {
+		ResponseData    = 0,
+		ResponseNothing = 1,
+		ResponseClose   = 2
+	};
+
+	struct Response {
+		ResponseType type;
+		String       data;
+	};
+
+	struct Request {
+		String headers;
+		String body;
+	};
+
+	std::recursive_mutex        m_mutex;
+	std::deque<Response>        m_responses;
+	std::vector<Request>        m_requests;
+	std::function<void(size_t)> m_requestHook;
+	String   m_defaultReply;
+	String   m_connectHost;         // the host name of the last connection
+	String   m_input;               // the request being received
+	String   m_output;              // the response being sent
+	size_t   m_outputPosition{ 0 }; // the first unread byte of m_output
+	size_t   m_holdAfter{ SIZE_MAX };
+	uint32_t m_connects{ 0 };
+	bool     m_isReachable{ true };
+	bool     m_isConnected{ false };
+	bool     m_isClosed{ false };   // closed by the server
+	bool     m_isStale{ false };    // closed by the server, not noticed by the client yet
+
+	// a stale connection is seen as closed from the first write or read
+	void noticeClose(void);
+
+	// get how many response bytes can be read
+	size_t getReadable(void);
+
+	// answer the received request (if the whole request has been received)
+	// returns
+	//   the number of requests received so far, zero if the request is not complete yet
+	size_t handleInput(void);
+};
+
+// build a getUpdates response with a single text message
+// params
+//   updateID: the update_id
+//   chatID  : the sender (and chat) ID
+//   text    : the message text, already JSON escaped
+// returns
+//   the JSON response
+String makeTextUpdate(int32_t updateID, int64_t chatID, const String& text);
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef CTBOT_TEST
+#define CTBOT_TEST
+
+#include <stdio.h>
+
+// a minimal test harness: every test is a function, a failed check is printed and counted.
+// The exit code of the test executable is the number of failed checks
+static int testFailures = 0;
+
+#define CHECK(condition)                                                            \
+	do {                                                                            \
+		if (!(condition)) {                                                         \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);    \
+			testFailures++;                                                         \
+		}                                                                           \
+	} while (0)
+
+#define RUN_TEST(test)                \
+	do {                              \
+		printf("--- %s\n", #test);    \
+		test();                       \
+	} while (0)
+
+#define TEST_RESULT() ((testFailures > 0) ? (printf("%d check(s) failed\n", testFailures), 1) : (printf("all passed\n"), 0))
+
+#endif
@@ -0,0 +1,277 @@
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <random>
+#include <thread>
+#include "Arduino.h"
+
+HardwareSerial Serial;
+EspClass       ESP;
+
+// time ---------------------------------------------------------------------------------------------------------
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> timeOffset{ 0 }; // microseconds added by hostAdvanceTime()
+
+unsigned long micros()
+{
+	auto elapsed = std::chrono::steady_clock::now() - startTime;
+	uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + timeOffset;
+	// 32 bit, as on the boards
+	return (uint32_t)us;
+}
+
+unsigned long millis()
+{
+	auto elapsed = std::chrono::steady_clock::now() - startTime;
+	uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + timeOffset;
+	return (uint32_t)(us / 1000);
+}
+
+void delay(unsigned long ms)
+{	std::this_thread::sleep_for(std::chrono::milliseconds(ms));}
+
+void delayMicroseconds(unsigned int us)
+{	std::this_thread::sleep_for(std::chrono::microseconds(us));}
+
+void yield()
+{	std::this_thread::yield();}
+
+void hostAdvanceTime(uint32_t ms)
+{	timeOffset += (uint64_t)ms * 1000;}
+
+// pins: no hardware, the last written value is read back -------------------------------------------------------
+static uint8_t pinValues[256];
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{	pinValues[pin] = value;}
+
+int digitalRead(uint8_t pin)
+{	return pinValues[pin];}
+
+// random numbers -----------------------------------------------------------------------------------------------
+static std::minstd_rand generator;
+
+long random(long max)
+{	return (max <= 0) ? 0 : (long)(generator() % (unsigned long)max);}
+
+long random(long min, long max)
+{	return (min >= max) ? min : min + random(max - min);}
+
+void randomSeed(unsigned long seed)
+{	generator.seed(seed);}
+
+// number conversions -------------------------------------------------------------------------------------------
+char* ltoa(long value, char* buffer, int base)
+{
+	strcpy(buffer, String(value, (unsigned char)base).c_str());
+	return buffer;
+}
+
+char* itoa(int value, char* buffer, int base)
+{	return ltoa(value, buffer, base);}
+
+char* ultoa(unsigned long value, char* buffer, int base)
+{
+	strcpy(buffer, String(value, (unsigned char)base).c_str());
+	return buffer;
+}
+
+// heap: every block allocated with operator new is counted ------------------------------------------------------
+static std::atomic<size_t> allocatedBytes{ 0 };
+
+// the block size is stored before the block (max_align_t keeps the alignment)
+static void* allocate(size_t size)
+{
+	void* block = malloc(size + sizeof(max_align_t));
+	if (NULL == block)
+		throw std::bad_alloc();
+	*(size_t*)block = size;
+	allocatedBytes += size;
+	return (uint8_t*)block + sizeof(max_align_t);
+}
+
+static void release(void* pointer)
+{
+	if (NULL == pointer)
+		return;
+	void* block = (uint8_t*)pointer - sizeof(max_align_t);
+	allocatedBytes -= *(size_t*)block;
+	free(block);
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* pointer) noexcept { release(pointer); }
+void operator delete[](void* pointer) noexcept { release(pointer); }
+void operator delete(void* pointer, size_t) noexcept { release(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { release(pointer); }
+
+size_t hostAllocatedBytes()
+{	return allocatedBytes;}
+
+uint32_t EspClass::getFreeHeap()
+{
+	size_t allocated = allocatedBytes;
+	return (allocated < CTBOT_HOST_HEAP_SIZE) ? CTBOT_HOST_HEAP_SIZE - allocated : 0;
+}
+
+// Print, Stream, serial port -----------------------------------------------------------------------------------
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+	size_t written = 0;
+	while ((written < size) && write(buffer[written]))
+		written++;
+	return written;
+}
+
+size_t Print::print(const __FlashStringHelper* value) { return write((const char*)value); }
+size_t Print::print(const String& value) { return write(value.c_str(), value.length()); }
+size_t Print::print(const char value[]) { return write(value); }
+size_t Print::print(char value) { return write((uint8_t)value); }
+size_t Print::print(unsigned char value, int base) { return print(String(value, (unsigned char)base)); }
+size_t Print::print(int value, int base) { return print(String(value, (unsigned char)base)); }
+size_t Print::print(unsigned int value, int base) { return print(String(value, (unsigned char)base)); }
+size_t Print::print(long value, int base) { return print(String(value, (unsigned char)base)); }
+size_t Print::print(unsigned long value, int base) { return print(String(value, (unsigned char)base)); }
+size_t Print::print(long long value, int base) { return print(String(value, (unsigned char)base)); }
+size_t Print::print(unsigned long long value, int base) { return print(String(value, (unsigned char)base)); }
+size_t Print::print(double value, int decimals) { return print(String(value, (unsigned char)decimals)); }
+size_t Print::print(const Printable& value) { return value.printTo(*this); }
+size_t Print::println() { return write("\r\n"); }
+
+int Stream::timedRead()
+{
+	unsigned long start = millis();
+	do {
+		int c = read();
+		if (c >= 0)
+			return c;
+		yield();
+	} while (millis() - start < m_timeout);
+	return -1;
+}
+
+size_t Stream::readBytes(char* buffer, size_t length)
+{
+	size_t count = 0;
+	while (count < length) {
+		int c = timedRead();
+		if (c < 0)
+			break;
+		buffer[count++] = (char)c;
+	}
+	return count;
+}
+
+String Stream::readString()
+{
+	String value;
+	int c;
+	while ((c = timedRead()) >= 0)
+		value += (char)c;
+	return value;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+	String value;
+	int c;
+	while (((c = timedRead()) >= 0) && (c != terminator))
+		value += (char)c;
+	return value;
+}
+
+bool Stream::find(const char* target)
+{
+	size_t length = strlen(target);
+	size_t matched = 0;
+	int c;
+	while ((matched < length) && ((c = timedRead()) >= 0))
+		matched = (c == target[matched]) ? matched + 1 : ((c == target[0]) ? 1 : 0);
+	return matched == length;
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{	return (fputc(value, stdout) == EOF) ? 0 : 1;}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{	return fwrite(buffer, 1, size, stdout);}
+
+void HardwareSerial::flush()
+{	fflush(stdout);}
+
+// IPAddress ----------------------------------------------------------------------------------------------------
+IPAddress::IPAddress(uint32_t address)
+{	memcpy(m_address, &address, sizeof(m_address));}
+
+IPAddress::operator uint32_t() const
+{
+	uint32_t address;
+	memcpy(&address, m_address, sizeof(address));
+	return address;
+}
+
+bool IPAddress::fromString(const char* address)
+{
+	uint8_t parsed[4];
+	uint8_t count = 0;
+	while (count < 4) {
+		if ((*address < '0') || (*address > '9'))
+			return false;
+		char* end;
+		long value = strtol(address, &end, 10);
+		if (value > 255)
+			return false;
+		parsed[count++] = (uint8_t)value;
+		address = end;
+		if (count < 4) {
+			if (*address != '.')
+				return false;
+			address++;
+		}
+	}
+	if (*address != 0x00)
+		return false;
+	memcpy(m_address, parsed, sizeof(m_address));
+	return true;
+}
+
+String IPAddress::toString() const
+{
+	char buffer[16];
+	snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", m_address[0], m_address[1], m_address[2], m_address[3]);
+	return buffer;
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+// FreeRTOS ------------------------------------------------------------------------------------------------------
+static thread_local TaskHandle_t currentTask = NULL;
+static std::atomic<uintptr_t> lastTask{ 0 };
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char*, uint32_t, void* parameters,
+	unsigned int, TaskHandle_t* task, int)
+{
+	TaskHandle_t handle = (TaskHandle_t)(++lastTask);
+	if (task != NULL)
+		*task = handle;
+	std::thread([function, parameters, handle]() {
+		currentTask = handle;
+		function(parameters);
+	}).detach();
+	return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+	// the main thread is the loop() task
+	static const TaskHandle_t loopTask = (TaskHandle_t)(++lastTask);
+	return (NULL == currentTask) ? loopTask : currentTask;
+}
+
+void vTaskDelete(TaskHandle_t) {}
+
+void vTaskDelay(uint32_t ticks)
+{	delay(ticks * portTICK_PERIOD_MS);}
+#endif
@@ -0,0 +1,123 @@
+#pragma once
+#ifndef CTBOT_SHIM_ARDUINO
+#define CTBOT_SHIM_ARDUINO
+
+// host (Linux) shim of the Arduino core: just what the library, the examples and ArduinoJson use.
+// The time is the real one (std::chrono), the heap is the one allocated with operator new
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "Client.h"
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HIGH   1
+#define LOW    0
+#define INPUT  0
+#define OUTPUT 1
+
+// no flash on the host: the "flash" strings are plain strings
+#define PROGMEM
+#define PGM_P           const char*
+#define PSTR(value)     (value)
+#define F(value)        (reinterpret_cast<const __FlashStringHelper*>(value))
+#define FPSTR(value)    (reinterpret_cast<const __FlashStringHelper*>(value))
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define strlen_P        strlen
+#define strcpy_P        strcpy
+#define strncpy_P       strncpy
+#define memcpy_P        memcpy
+#define strcmp_P        strcmp
+#define strncasecmp_P   strncasecmp
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int  digitalRead(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+char* ltoa(long value, char* buffer, int base);
+char* itoa(int value, char* buffer, int base);
+char* ultoa(unsigned long value, char* buffer, int base);
+
+// the serial port: the output is written on stdout
+class HardwareSerial : public Stream
+{
+public:
+	void begin(unsigned long) {}
+	void end(void) {}
+	size_t write(uint8_t value) override;
+	size_t write(const uint8_t* buffer, size_t size) override;
+	int available(void) override { return 0; }
+	int read(void) override { return -1; }
+	int peek(void) override { return -1; }
+	void flush(void) override;
+	operator bool(void) const { return true; }
+	using Print::write;
+};
+extern HardwareSerial Serial;
+
+// the heap functions of the ESP cores: the free heap is a virtual CTBOT_HOST_HEAP_SIZE bytes heap,
+// minus the bytes allocated with operator new (String, TBMessage...)
+#ifndef CTBOT_HOST_HEAP_SIZE
+#define CTBOT_HOST_HEAP_SIZE 81920
+#endif
+class EspClass
+{
+public:
+	uint32_t getFreeHeap(void);
+	uint32_t getMaxFreeBlockSize(void) { return getFreeHeap(); }
+	uint32_t getMaxAllocHeap(void) { return getFreeHeap(); }
+	uint8_t  getHeapFragmentation(void) { return 0; }
+	uint32_t getCycleCount(void) { return micros(); }
+	void restart(void) { exit(0); }
+};
+extern EspClass ESP;
+
+#if defined(ARDUINO_ARCH_ESP32)
+// FreeRTOS: every task is a std::thread (the core and the priority are ignored)
+typedef void* TaskHandle_t;
+typedef int   BaseType_t;
+typedef void (*TaskFunction_t)(void* parameters);
+#define pdPASS 1
+#define pdFAIL 0
+#define portTICK_PERIOD_MS 1
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize, void* parameters,
+	unsigned int priority, TaskHandle_t* task, int core);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(uint32_t ticks);
+#endif
+
+// host only: move the clock forward (i.e. to expire a backoff without waiting for it)
+// params
+//   ms: how many milliseconds to add to millis() and micros()
+void hostAdvanceTime(uint32_t ms);
+
+// host only: how many bytes are allocated with operator new
+// returns
+//   the allocated bytes
+size_t hostAllocatedBytes(void);
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef CTBOT_SHIM_CLIENT
+#define CTBOT_SHIM_CLIENT
+
+#include "Stream.h"
+#include "IPAddress.h"
+
+// the Arduino Client class: a TCP (or TLS) connection
+class Client : public Stream
+{
+public:
+	virtual int connect(IPAddress ip, uint16_t port) = 0;
+	virtual int connect(const char* host, uint16_t port) = 0;
+	virtual size_t write(uint8_t value) = 0;
+	virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+	virtual int available(void) = 0;
+	virtual int read(void) = 0;
+	virtual int read(uint8_t* buffer, size_t size) = 0;
+	virtual int peek(void) = 0;
+	virtual void flush(void) = 0;
+	virtual void stop(void) = 0;
+	virtual uint8_t connected(void) = 0;
+	virtual operator bool(void) = 0;
+	using Print::write;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+#ifndef CTBOT_SHIM_IPADDRESS
+#define CTBOT_SHIM_IPADDRESS
+
+#include <stdint.h>
+#include "WString.h"
+
+// the Arduino IPAddress class (IPv4 only)
+class IPAddress
+{
+public:
+	IPAddress() {}
+	IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth) : m_address{ first, second, third, fourth } {}
+	IPAddress(uint32_t address);
+
+	bool fromString(const char* address);
+	bool fromString(const String& address) { return fromString(address.c_str()); }
+	String toString(void) const;
+	bool isSet(void) const { return operator uint32_t() != 0; }
+
+	operator uint32_t(void) const;
+	bool operator==(const IPAddress& address) const { return operator uint32_t() == (uint32_t)address; }
+	uint8_t operator[](int index) const { return m_address[index]; }
+	uint8_t& operator[](int index) { return m_address[index]; }
+
+private:
+	uint8_t m_address[4]{ 0, 0, 0, 0 };
+};
+
+#endif
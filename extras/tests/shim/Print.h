@@ -0,0 +1,59 @@
+#pragma once
+#ifndef CTBOT_SHIM_PRINT
+#define CTBOT_SHIM_PRINT
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print;
+
+// an object that can print itself (i.e. a JSON body serialized straight to the connection)
+class Printable
+{
+public:
+	virtual ~Printable() {}
+	virtual size_t printTo(Print& output) const = 0;
+};
+
+// the Arduino Print class
+class Print
+{
+public:
+	virtual ~Print() {}
+
+	virtual size_t write(uint8_t value) = 0;
+	virtual size_t write(const uint8_t* buffer, size_t size);
+	size_t write(const char* value) { return (NULL == value) ? 0 : write((const uint8_t*)value, strlen(value)); }
+	size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+	virtual int availableForWrite(void) { return 0; }
+	virtual void flush(void) {}
+
+	size_t print(const __FlashStringHelper* value);
+	size_t print(const String& value);
+	size_t print(const char value[]);
+	size_t print(char value);
+	size_t print(unsigned char value, int base = DEC);
+	size_t print(int value, int base = DEC);
+	size_t print(unsigned int value, int base = DEC);
+	size_t print(long value, int base = DEC);
+	size_t print(unsigned long value, int base = DEC);
+	size_t print(long long value, int base = DEC);
+	size_t print(unsigned long long value, int base = DEC);
+	size_t print(double value, int decimals = 2);
+	size_t print(const Printable& value);
+
+	size_t println(void);
+	template <typename T>
+	size_t println(const T& value) { return print(value) + println(); }
+	template <typename T>
+	size_t println(const T& value, int format) { return print(value, format) + println(); }
+};
+
+#endif
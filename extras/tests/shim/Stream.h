@@ -0,0 +1,31 @@
+#pragma once
+#ifndef CTBOT_SHIM_STREAM
+#define CTBOT_SHIM_STREAM
+
+#include "Print.h"
+
+// the Arduino Stream class: the reads wait for the data up to the stream timeout
+class Stream : public Print
+{
+public:
+	virtual int available(void) = 0;
+	virtual int read(void) = 0;
+	virtual int peek(void) = 0;
+
+	void setTimeout(unsigned long timeout) { m_timeout = timeout; }
+	unsigned long getTimeout(void) const { return m_timeout; }
+
+	size_t readBytes(char* buffer, size_t length);
+	size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+	String readString(void);
+	String readStringUntil(char terminator);
+	bool find(const char* target);
+
+protected:
+	unsigned long m_timeout{ 1000 };
+
+	// read a byte, waiting up to the timeout
+	int timedRead(void);
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "WString.h"
+
+// the number to string conversions of the Arduino core
+static std::string toBase(unsigned long long value, unsigned char base, bool isNegative)
+{
+	if ((base < 2) || (base > 36))
+		base = 10;
+	std::string digits;
+	do {
+		uint8_t digit = value % base;
+		digits.insert(digits.begin(), (char)((digit < 10) ? '0' + digit : 'a' + digit - 10));
+		value /= base;
+	} while (value != 0);
+	if (isNegative)
+		digits.insert(digits.begin(), '-');
+	return digits;
+}
+
+static std::string toSigned(long long value, unsigned char base)
+{
+	// only the decimal numbers have a sign
+	if ((value < 0) && (10 == base))
+		return toBase(0 - (unsigned long long)value, base, true);
+	return toBase((unsigned long long)value, base, false);
+}
+
+static std::string toDecimals(double value, unsigned char decimals)
+{
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+	return buffer;
+}
+
+String::String(const char* value) : m_value(value ? value : "") {}
+String::String(const char* value, unsigned int length) : m_value(value ? value : "", value ? length : 0) {}
+String::String(const __FlashStringHelper* value) : m_value(value ? (const char*)value : "") {}
+String::String(char value) : m_value(1, value) {}
+String::String(unsigned char value, unsigned char base) : m_value(toBase(value, base, false)) {}
+String::String(int value, unsigned char base) : m_value(toSigned(value, base)) {}
+String::String(unsigned int value, unsigned char base) : m_value(toBase(value, base, false)) {}
+String::String(long value, unsigned char base) : m_value(toSigned(value, base)) {}
+String::String(unsigned long value, unsigned char base) : m_value(toBase(value, base, false)) {}
+String::String(long long value, unsigned char base) : m_value(toSigned(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : m_value(toBase(value, base, false)) {}
+String::String(float value, unsigned char decimals) : m_value(toDecimals(value, decimals)) {}
+String::String(double value, unsigned char decimals) : m_value(toDecimals(value, decimals)) {}
+
+String& String::operator=(const char* value)
+{
+	m_value = value ? value : "";
+	return *this;
+}
+
+unsigned char String::reserve(unsigned int size)
+{
+	m_value.reserve(size);
+	return 1;
+}
+
+unsigned char String::concat(const String& value) { m_value += value.m_value; return 1; }
+unsigned char String::concat(const char* value) { if (value) m_value += value; return value != NULL; }
+unsigned char String::concat(const char* value, unsigned int length) { if (value) m_value.append(value, length); return value != NULL; }
+unsigned char String::concat(char value) { m_value += value; return 1; }
+unsigned char String::concat(unsigned char value) { return concat(String(value)); }
+unsigned char String::concat(int value) { return concat(String(value)); }
+unsigned char String::concat(unsigned int value) { return concat(String(value)); }
+unsigned char String::concat(long value) { return concat(String(value)); }
+unsigned char String::concat(unsigned long value) { return concat(String(value)); }
+unsigned char String::concat(long long value) { return concat(String(value)); }
+unsigned char String::concat(unsigned long long value) { return concat(String(value)); }
+unsigned char String::concat(float value) { return concat(String(value)); }
+unsigned char String::concat(double value) { return concat(String(value)); }
+unsigned char String::concat(const __FlashStringHelper* value) { return concat((const char*)value); }
+
+unsigned char String::equalsIgnoreCase(const String& value) const
+{
+	return (length() == value.length()) && (0 == strcasecmp(c_str(), value.c_str()));
+}
+
+unsigned char String::startsWith(const String& prefix) const
+{
+	return 0 == m_value.compare(0, prefix.length(), prefix.m_value);
+}
+
+unsigned char String::endsWith(const String& suffix) const
+{
+	return (length() >= suffix.length()) &&
+		(0 == m_value.compare(length() - suffix.length(), suffix.length(), suffix.m_value));
+}
+
+char& String::operator[](unsigned int index)
+{
+	static char dummy;
+	if (index >= length()) {
+		dummy = 0;
+		return dummy;
+	}
+	return m_value[index];
+}
+
+int String::indexOf(char value, unsigned int from) const
+{
+	size_t position = m_value.find(value, from);
+	return (std::string::npos == position) ? -1 : (int)position;
+}
+
+int String::indexOf(const String& value, unsigned int from) const
+{
+	size_t position = m_value.find(value.m_value, from);
+	return (std::string::npos == position) ? -1 : (int)position;
+}
+
+int String::lastIndexOf(char value) const
+{
+	size_t position = m_value.rfind(value);
+	return (std::string::npos == position) ? -1 : (int)position;
+}
+
+int String::lastIndexOf(const String& value) const
+{
+	size_t position = m_value.rfind(value.m_value);
+	return (std::string::npos == position) ? -1 : (int)position;
+}
+
+String String::substring(unsigned int from) const
+{
+	return substring(from, length());
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+	if (from > to) {
+		unsigned int swap = from;
+		from = to;
+		to = swap;
+	}
+	if (from >= length())
+		return String();
+	if (to > length())
+		to = length();
+	return String(m_value.c_str() + from, to - from);
+}
+
+void String::replace(char find, char replace)
+{
+	for (char& c : m_value) {
+		if (c == find)
+			c = replace;
+	}
+}
+
+void String::replace(const String& find, const String& replace)
+{
+	if (0 == find.length())
+		return;
+	size_t position = 0;
+	while ((position = m_value.find(find.m_value, position)) != std::string::npos) {
+		m_value.replace(position, find.length(), replace.m_value);
+		position += replace.length();
+	}
+}
+
+void String::remove(unsigned int index)
+{
+	if (index < length())
+		m_value.erase(index);
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+	if (index < length())
+		m_value.erase(index, count);
+}
+
+void String::toLowerCase()
+{
+	for (char& c : m_value)
+		c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase()
+{
+	for (char& c : m_value)
+		c = toupper((unsigned char)c);
+}
+
+void String::trim()
+{
+	size_t first = m_value.find_first_not_of(" \t\r\n\f\v");
+	if (std::string::npos == first) {
+		m_value.clear();
+		return;
+	}
+	size_t last = m_value.find_last_not_of(" \t\r\n\f\v");
+	m_value = m_value.substr(first, last - first + 1);
+}
+
+long String::toInt() const
+{	return atol(c_str());}
+
+float String::toFloat() const
+{	return (float)atof(c_str());}
+
+double String::toDouble() const
+{	return atof(c_str());}
@@ -0,0 +1,136 @@
+#pragma once
+#ifndef CTBOT_SHIM_WSTRING
+#define CTBOT_SHIM_WSTRING
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+class __FlashStringHelper;
+
+// the Arduino String class, backed by a std::string. Only the members used by the library,
+// the examples and ArduinoJson (ARDUINOJSON_ENABLE_ARDUINO_STRING) are implemented
+class String
+{
+public:
+	String(const char* value = "");
+	String(const char* value, unsigned int length);
+	String(const __FlashStringHelper* value);
+	String(const String& value) = default;
+	String(String&& value) = default;
+	explicit String(char value);
+	explicit String(unsigned char value, unsigned char base = 10);
+	explicit String(int value, unsigned char base = 10);
+	explicit String(unsigned int value, unsigned char base = 10);
+	explicit String(long value, unsigned char base = 10);
+	explicit String(unsigned long value, unsigned char base = 10);
+	explicit String(long long value, unsigned char base = 10);
+	explicit String(unsigned long long value, unsigned char base = 10);
+	explicit String(float value, unsigned char decimals = 2);
+	explicit String(double value, unsigned char decimals = 2);
+
+	String& operator=(const String& value) = default;
+	String& operator=(String&& value) = default;
+	String& operator=(const char* value);
+
+	unsigned char reserve(unsigned int size);
+	unsigned int length(void) const { return m_value.length(); }
+	const char* c_str(void) const { return m_value.c_str(); }
+	char* begin(void) { return &m_value[0]; }
+	char* end(void) { return &m_value[0] + m_value.length(); }
+	const char* begin(void) const { return m_value.c_str(); }
+	const char* end(void) const { return m_value.c_str() + m_value.length(); }
+
+	unsigned char concat(const String& value);
+	unsigned char concat(const char* value);
+	unsigned char concat(const char* value, unsigned int length);
+	unsigned char concat(char value);
+	unsigned char concat(unsigned char value);
+	unsigned char concat(int value);
+	unsigned char concat(unsigned int value);
+	unsigned char concat(long value);
+	unsigned char concat(unsigned long value);
+	unsigned char concat(long long value);
+	unsigned char concat(unsigned long long value);
+	unsigned char concat(float value);
+	unsigned char concat(double value);
+	unsigned char concat(const __FlashStringHelper* value);
+
+	template <typename T>
+	String& operator+=(const T& value) { concat(value); return *this; }
+
+	int compareTo(const String& value) const { return m_value.compare(value.m_value); }
+	unsigned char equals(const String& value) const { return m_value == value.m_value; }
+	unsigned char equals(const char* value) const { return m_value == (value ? value : ""); }
+	unsigned char equalsIgnoreCase(const String& value) const;
+	unsigned char startsWith(const String& prefix) const;
+	unsigned char endsWith(const String& suffix) const;
+	bool operator==(const String& value) const { return equals(value); }
+	bool operator==(const char* value) const { return equals(value); }
+	bool operator!=(const String& value) const { return !equals(value); }
+	bool operator!=(const char* value) const { return !equals(value); }
+	bool operator<(const String& value) const { return compareTo(value) < 0; }
+
+	char charAt(unsigned int index) const { return (*this)[index]; }
+	void setCharAt(unsigned int index, char value) { if (index < length()) m_value[index] = value; }
+	char operator[](unsigned int index) const { return (index < length()) ? m_value[index] : 0; }
+	char& operator[](unsigned int index);
+
+	int indexOf(char value, unsigned int from = 0) const;
+	int indexOf(const String& value, unsigned int from = 0) const;
+	int lastIndexOf(char value) const;
+	int lastIndexOf(const String& value) const;
+	String substring(unsigned int from) const;
+	String substring(unsigned int from, unsigned int to) const;
+
+	void replace(char find, char replace);
+	void replace(const String& find, const String& replace);
+	void remove(unsigned int index);
+	void remove(unsigned int index, unsigned int count);
+	void toLowerCase(void);
+	void toUpperCase(void);
+	void trim(void);
+
+	long toInt(void) const;
+	float toFloat(void) const;
+	double toDouble(void) const;
+
+private:
+	std::string m_value;
+};
+
+inline bool operator==(const char* left, const String& right) { return right == left; }
+inline bool operator!=(const char* left, const String& right) { return right != left; }
+
+// the result of a String concatenation (the type is used by ArduinoJson)
+class StringSumHelper : public String
+{
+public:
+	StringSumHelper(const String& value) : String(value) {}
+};
+
+template <typename T>
+StringSumHelper operator+(const String& left, const T& right)
+{
+	StringSumHelper sum(left);
+	sum.concat(right);
+	return sum;
+}
+
+// 'a' + String
+inline StringSumHelper operator+(char left, const String& right)
+{
+	StringSumHelper sum{ String(left) };
+	sum.concat(right);
+	return sum;
+}
+
+// "abc" + String
+inline StringSumHelper operator+(const char* left, const String& right)
+{
+	StringSumHelper sum{ String(left) };
+	sum.concat(right);
+	return sum;
+}
+
+#endif
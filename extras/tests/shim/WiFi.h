@@ -0,0 +1,85 @@
+#pragma once
+#ifndef CTBOT_SHIM_WIFI
+#define CTBOT_SHIM_WIFI
+
+#include "Arduino.h"
+
+typedef enum {
+	WL_IDLE_STATUS     = 0,
+	WL_NO_SSID_AVAIL   = 1,
+	WL_CONNECTED       = 3,
+	WL_CONNECT_FAILED  = 4,
+	WL_CONNECTION_LOST = 5,
+	WL_DISCONNECTED    = 6
+} wl_status_t;
+
+typedef enum {
+	WIFI_OFF    = 0,
+	WIFI_STA    = 1,
+	WIFI_AP     = 2,
+	WIFI_AP_STA = 3
+} WiFiMode_t;
+
+// the WiFi: always connected, unless a test says otherwise. The DNS lookups fail, unless a test sets the address
+class WiFiClass
+{
+public:
+	wl_status_t status(void) { return m_status; }
+	bool mode(WiFiMode_t) { return true; }
+	wl_status_t begin(const char*, const char* = NULL) { return m_status; }
+	bool config(IPAddress, IPAddress, IPAddress, IPAddress = IPAddress(), IPAddress = IPAddress()) { return true; }
+	IPAddress localIP(void) { return IPAddress(127, 0, 0, 1); }
+	int hostByName(const char*, IPAddress& ip) { ip = m_hostAddress; return m_hostAddress.isSet() ? 1 : 0; }
+	bool reconnect(void) { m_reconnects++; return true; }
+	bool isConnected(void) { return WL_CONNECTED == m_status; }
+
+	// host only: set the WiFi status
+	void setStatus(wl_status_t status) { m_status = status; }
+
+	// host only: set the address returned by the DNS lookups. Not set (default) -> the lookups fail
+	void setHostAddress(const IPAddress& ip) { m_hostAddress = ip; }
+
+	// host only: how many times reconnect() has been called
+	uint32_t getReconnectCount(void) const { return m_reconnects; }
+
+private:
+	wl_status_t m_status{ WL_CONNECTED };
+	uint32_t    m_reconnects{ 0 };
+	IPAddress   m_hostAddress;
+};
+extern WiFiClass WiFi;
+
+// a TCP connection: there is no network, every connection fails
+class WiFiClient : public Client
+{
+public:
+	int connect(IPAddress, uint16_t) override { return 0; }
+	int connect(const char*, uint16_t) override { return 0; }
+	size_t write(uint8_t) override { return 0; }
+	size_t write(const uint8_t*, size_t) override { return 0; }
+	int available(void) override { return 0; }
+	int read(void) override { return -1; }
+	int read(uint8_t*, size_t) override { return -1; }
+	int peek(void) override { return -1; }
+	void flush(void) override {}
+	void stop(void) override {}
+	uint8_t connected(void) override { return 0; }
+	operator bool(void) override { return false; }
+	void setNoDelay(bool) {}
+	IPAddress remoteIP(void) { return IPAddress(); }
+	using Print::write;
+};
+
+// a TCP server: no connection is ever accepted
+class WiFiServer
+{
+public:
+	explicit WiFiServer(uint16_t) {}
+	void begin(void) {}
+	void stop(void) {}
+	void setNoDelay(bool) {}
+	WiFiClient accept(void) { return WiFiClient(); }
+	WiFiClient available(void) { return WiFiClient(); }
+};
+
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+#ifndef CTBOT_SHIM_WIFICLIENTSECURE
+#define CTBOT_SHIM_WIFICLIENTSECURE
+
+#include "WiFi.h"
+
+// a TLS connection (ESP32 API): there is no network, every connection fails.
+// The tests replace it with a fake Telegram server (see CTBot::setTransport())
+class WiFiClientSecure : public WiFiClient
+{
+public:
+	void setInsecure(void) {}
+	void setCACert(const char*) {}
+};
+
+#endif
@@ -0,0 +1,279 @@
+// CTBot against the in-memory Telegram server: updates, sends and background task
+#include <atomic>
+#include <thread>
+#include "CTBot.h"
+#include "FakeTelegramServer.h"
+#include "test.h"
+
+static const char okResponse[]    = "{\"ok\":true,\"result\":{\"message_id\":1}}";
+static const char emptyResponse[] = "{\"ok\":true,\"result\":[]}";
+
+static void setupBot(CTBot& bot, FakeTelegramServer& server)
+{
+	bot.setTransport(&server);
+	bot.setTelegramToken("123:abc");
+}
+
+static void testGetNewMessage()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+
+	TBMessage message;
+	server.reply(makeTextUpdate(100, 42, "hello"));
+	CHECK(bot.getNewMessage(message) == CTBotMessageText);
+	CHECK(message.text == "hello");
+	CHECK(message.sender.id == 42);
+	CHECK(message.sender.username == "tester");
+	CHECK(server.getRequest(0).startsWith("GET /bot123:abc/getUpdates?limit="));
+
+	// the update is marked as read
+	server.reply(emptyResponse);
+	CHECK(bot.getNewMessage(message) == CTBotMessageNoData);
+	CHECK(server.getRequest(1).indexOf("&offset=101") > 0);
+}
+
+static void testBatch()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+
+	// three updates with a single request
+	String json = "{\"ok\":true,\"result\":[";
+	for (uint8_t i = 0; i < 3; i++) {
+		String update = makeTextUpdate(200 + i, 42, String(i));
+		json += update.substring(update.indexOf('[') + 1, update.lastIndexOf(']'));
+		json += (i < 2) ? "," : "]}";
+	}
+	server.reply(json);
+
+	TBMessage message;
+	for (uint8_t i = 0; i < 3; i++) {
+		CHECK(bot.getNewMessage(message) == CTBotMessageText);
+		CHECK(message.text == String(i));
+	}
+	CHECK(server.getRequestCount() == 1);
+}
+
+// the last request sent to the server
+static String lastRequest(FakeTelegramServer& server)
+{
+	return server.getRequest(server.getRequestCount() - 1);
+}
+
+static void testOversizedUpdate()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+
+	// the text alone doesn't fit the JSON document: the server sends it again until it is marked as read
+	String text;
+	while (text.length() < 2 * CTBOT_JSON6_BUFFER_SIZE)
+		text += "Lorem ipsum dolor sit amet. ";
+	server.setDefaultReply(makeTextUpdate(600, 42, text));
+
+	TBMessage message;
+	for (uint8_t i = 0; (i < 10) && (lastRequest(server).indexOf("&offset=601") < 0); i++)
+		CHECK(bot.getNewMessage(message) == CTBotMessageNoData);
+	CHECK(lastRequest(server).indexOf("&offset=601") > 0);
+
+	// the next updates are received
+	server.setDefaultReply(emptyResponse);
+	server.reply(makeTextUpdate(601, 42, "next"));
+	CHECK(bot.getNewMessage(message) == CTBotMessageText);
+	CHECK(message.text == "next");
+
+	// the same with the asynchronous requests
+	server.setDefaultReply(makeTextUpdate(700, 42, text));
+	for (uint8_t i = 0; (i < 10) && (lastRequest(server).indexOf("&offset=701") < 0); i++) {
+		bot.beginGetUpdates();
+		uint32_t start = millis();
+		while (bot.isAsyncBusy() && (millis() - start < 1000))
+			bot.tick();
+	}
+	CHECK(lastRequest(server).indexOf("&offset=701") > 0);
+}
+
+static void testMessageView()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+
+	TBMessageView message;
+	server.reply(makeTextUpdate(300, 42, "view"));
+	CHECK(bot.getNewMessage(message) == CTBotMessageText);
+	CHECK(0 == strcmp(message.text, "view"));
+	CHECK(message.sender.id == 42);
+	CHECK(!message.sender.isBot);
+	CHECK(0 == strcmp(message.sender.languageCode, "it"));
+}
+
+static void testMessageViewQueued()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+
+	// two updates with a single request: the second one is queued
+	String first = makeTextUpdate(600, 42, "first");
+	String second = makeTextUpdate(601, 42, "second");
+	server.reply(first.substring(0, first.lastIndexOf(']')) + "," +
+		second.substring(second.indexOf('[') + 1));
+	TBMessage message;
+	CHECK(bot.getNewMessage(message) == CTBotMessageText);
+	CHECK(message.text == "first");
+
+	// the queued message can't be referenced by a view: it is left for the TBMessage version
+	TBMessageView view;
+	CHECK(bot.getNewMessage(view) == CTBotMessageNoData);
+	CHECK(server.getRequestCount() == 1);
+	CHECK(bot.getNewMessage(message) == CTBotMessageText);
+	CHECK(message.text == "second");
+
+	server.reply(makeTextUpdate(602, 42, "view"));
+	CHECK(bot.getNewMessage(view) == CTBotMessageText);
+	CHECK(0 == strcmp(view.text, "view"));
+	CHECK(server.getRequest(1).indexOf("&offset=602") > 0);
+}
+
+static void testSendMessage()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+
+	server.reply(okResponse);
+	CHECK(bot.sendMessage(42, "hi"));
+#if CTBOT_USE_POST > 0
+	CHECK(server.getRequest(0).startsWith("POST /bot123:abc/sendMessage HTTP/1.1\r\n"));
+	CHECK(server.getBody(0).indexOf("\"chat_id\":42") >= 0);
+	CHECK(server.getBody(0).indexOf("\"text\":\"hi\"") >= 0);
+#endif
+
+	// the server refuses the message
+	server.reply("{\"ok\":false,\"error_code\":400,\"description\":\"Bad Request\"}");
+	CHECK(!bot.sendMessage(42, "hi"));
+}
+
+static uint32_t received;
+
+static void onMessage(TBMessage& message)
+{
+	if (message.text == "async")
+		received++;
+}
+
+static void testAsync()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+	server.setDefaultReply(emptyResponse);
+
+	received = 0;
+	bot.setMessageCallback(onMessage);
+	server.reply(makeTextUpdate(400, 42, "async"));
+	CHECK(bot.beginGetUpdates());
+	uint32_t start = millis();
+	while ((0 == received) && (millis() - start < 1000))
+		bot.tick();
+	CHECK(1 == received);
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+static void testBackgroundTask()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+	server.setDefaultReply(emptyResponse);
+
+	server.reply(makeTextUpdate(500, 42, "background"));
+	CHECK(bot.startBackgroundTask());
+	CHECK(bot.isBackgroundRunning());
+
+	// the message is received by the task, getNewMessage() never blocks
+	TBMessage message;
+	uint32_t start = millis();
+	while ((bot.getNewMessage(message) != CTBotMessageText) && (millis() - start < 1000))
+		delay(1);
+	CHECK(message.text == "background");
+
+	bot.stopBackgroundTask();
+	CHECK(!bot.isBackgroundRunning());
+}
+
+static void testBackgroundTaskStop()
+{
+	FakeTelegramServer server;
+	CTBot bot;
+	setupBot(bot, server);
+	server.setDefaultReply(emptyResponse);
+
+	// the second getUpdates is held until the task is asked to stop: the task then completes
+	// its step with a message already handed over to loop() and a new one just received
+	server.reply(makeTextUpdate(800, 42, "first"));
+	server.reply(makeTextUpdate(801, 42, "second"));
+	server.setRequestHook([&bot](size_t count) {
+		if (2 == count) {
+			while (bot.isBackgroundRunning())
+				delay(1);
+		}
+	});
+	CHECK(bot.startBackgroundTask());
+	uint32_t start = millis();
+	while ((server.getRequestCount() < 2) && (millis() - start < 1000))
+		delay(1);
+	CHECK(server.getRequestCount() == 2);
+
+	// the stop must not hang: it is watched by another thread
+	std::atomic<bool> isStopped{ false };
+	std::thread stopper([&bot, &isStopped]() {
+		bot.stopBackgroundTask();
+		isStopped = true;
+	});
+	start = millis();
+	while (!isStopped && (millis() - start < 2000))
+		delay(1);
+	if (!isStopped) {
+		printf("%s:%d: stopBackgroundTask() hangs\n", __FILE__, __LINE__);
+		// the stuck task can't be joined
+		exit(1);
+	}
+	stopper.join();
+	server.setRequestHook(NULL);
+
+	// the getUpdates left in progress by the task is completed by tick()
+	start = millis();
+	while (bot.isAsyncBusy() && (millis() - start < 1000))
+		bot.tick();
+
+	// no message is lost or duplicated, the order is kept
+	TBMessage message;
+	CHECK(bot.getNewMessage(message) == CTBotMessageText);
+	CHECK(message.text == "first");
+	CHECK(bot.getNewMessage(message) == CTBotMessageText);
+	CHECK(message.text == "second");
+	CHECK(bot.getNewMessage(message) == CTBotMessageNoData);
+}
+#endif
+
+int main()
+{
+	RUN_TEST(testGetNewMessage);
+	RUN_TEST(testBatch);
+	RUN_TEST(testOversizedUpdate);
+	RUN_TEST(testMessageView);
+	RUN_TEST(testMessageViewQueued);
+	RUN_TEST(testSendMessage);
+	RUN_TEST(testAsync);
+#if defined(ARDUINO_ARCH_ESP32)
+	RUN_TEST(testBackgroundTask);
+	RUN_TEST(testBackgroundTaskStop);
+#endif
+	return TEST_RESULT();
+}
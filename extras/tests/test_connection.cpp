@@ -0,0 +1,298 @@
+// CTBotSecureConnection against the in-memory Telegram server: HTTP framing, keep alive,
+// asynchronous requests and circuit breaker
+#include "CTBotSecureConnection.h"
+#include "FakeTelegramServer.h"
+#include "test.h"
+
+static const char okResponse[] = "{\"ok\":true,\"result\":{\"id\":1,\"is_bot\":true}}";
+
+// a POST body
+class StringBody : public Printable
+{
+public:
+	explicit StringBody(const String& body) : m_body(body) {}
+	size_t printTo(Print& output) const override { return output.print(m_body); }
+
+private:
+	const String& m_body;
+};
+
+// run an asynchronous request until it is done (or failed)
+static CTBotRequestState pollUntilDone(CTBotSecureConnection& connection, uint32_t timeout)
+{
+	uint32_t start = millis();
+	CTBotRequestState state;
+	while (((state = connection.poll(CTBOT_ASYNC_TICK_BUDGET)) != CTBotRequestDone) &&
+		(state != CTBotRequestError) && (millis() - start < timeout))
+		delay(1);
+	return state;
+}
+
+static void testSend()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+
+	server.reply(okResponse);
+	CHECK(connection.send("GET /bot123:abc/getMe") == okResponse);
+	CHECK(connection.getStatusCode() == 200);
+	CHECK(server.getRequestCount() == 1);
+	CHECK(server.getRequest(0).startsWith("GET /bot123:abc/getMe HTTP/1.1\r\n"));
+	CHECK(server.getRequest(0).indexOf("Connection: close\r\n") > 0);
+}
+
+static void testSendText()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+
+	// the text is URL encoded straight to the connection
+	server.reply(okResponse);
+	CHECK(connection.send("GET /bot123:abc/sendMessage?chat_id=1&text=", "a b&c") == okResponse);
+	CHECK(server.getRequest(0).startsWith("GET /bot123:abc/sendMessage?chat_id=1&text=a%20b%26c HTTP/1.1\r\n"));
+}
+
+static void testPostBody()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+
+	String body = "{\"chat_id\":1,\"text\":\"hello\"}";
+	server.reply(okResponse);
+	connection.beginRequest("POST /bot123:abc/sendMessage", 1000, body);
+	CHECK(pollUntilDone(connection, 1000) == CTBotRequestDone);
+	CHECK(connection.takeResponse() == okResponse);
+	CHECK(server.getRequest(0).indexOf("Content-Type: application/json\r\n") > 0);
+	CHECK(server.getBody(0) == body);
+}
+
+static void testKeepAlive()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+	connection.useKeepAlive(true);
+
+	for (uint8_t i = 0; i < 3; i++) {
+		server.reply(okResponse);
+		CHECK(connection.send("GET /bot123:abc/getMe") == okResponse);
+	}
+	CHECK(server.getConnectCount() == 1);
+	CHECK(connection.getHandshakeCount() == 1);
+	CHECK(server.getRequest(0).indexOf("Connection: keep-alive\r\n") > 0);
+
+	// the server drops the idle connection: a new one is opened
+	server.closeConnection();
+	server.reply(okResponse);
+	CHECK(connection.send("GET /bot123:abc/getMe") == okResponse);
+	CHECK(server.getConnectCount() == 2);
+	CHECK(connection.getReconnectCount() == 1);
+}
+
+static void testNoDuplicate()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+	connection.useKeepAlive(true);
+	connection.setResponseTimeout(50);
+
+	String body = "{\"chat_id\":1,\"text\":\"once\"}";
+	StringBody message(body);
+	server.reply(okResponse);
+	CHECK(connection.send("POST /bot123:abc/sendMessage", message, body.length()) == okResponse);
+
+	// no answer on the kept alive connection: the server may have handled the message, it is not sent again
+	server.replyNothing();
+	CHECK(connection.send("POST /bot123:abc/sendMessage", message, body.length()) == "");
+	CHECK(server.getRequestCount() == 2);
+
+	// the server closes the kept alive connection without answering: the request is sent again
+	server.reply(okResponse);
+	CHECK(connection.send("GET /bot123:abc/getMe") == okResponse);
+	server.replyClose();
+	server.reply(okResponse);
+	CHECK(connection.send("POST /bot123:abc/sendMessage", message, body.length()) == okResponse);
+	CHECK(server.getRequestCount() == 5);
+	CHECK(server.getBody(4) == body);
+}
+
+static void testAsyncKeepAlive()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+	connection.useKeepAlive(true);
+
+	String body = "{\"chat_id\":1,\"text\":\"once\"}";
+	server.reply(okResponse);
+	CHECK(connection.beginRequest("GET /bot123:abc/getMe", 1000));
+	CHECK(pollUntilDone(connection, 1000) == CTBotRequestDone);
+	CHECK(connection.takeResponse() == okResponse);
+
+	// the server drops the idle connection: the write fails, the request is sent again with a new connection
+	server.closeConnection();
+	server.reply(okResponse);
+	CHECK(connection.beginRequest("POST /bot123:abc/sendMessage", 1000, body));
+	CHECK(pollUntilDone(connection, 1000) == CTBotRequestDone);
+	CHECK(connection.takeResponse() == okResponse);
+	CHECK(server.getConnectCount() == 2);
+	CHECK(connection.getReconnectCount() == 1);
+	CHECK(server.getRequestCount() == 2);
+	CHECK(server.getBody(1) == body);
+
+	// the server closes the kept alive connection without answering: the request is sent again
+	server.replyClose();
+	server.reply(okResponse);
+	CHECK(connection.beginRequest("POST /bot123:abc/sendMessage", 1000, body));
+	CHECK(pollUntilDone(connection, 1000) == CTBotRequestDone);
+	CHECK(connection.takeResponse() == okResponse);
+	CHECK(server.getRequestCount() == 4);
+	CHECK(server.getBody(3) == body);
+
+	// no answer: the server may have handled the message, it is not sent again
+	server.replyNothing();
+	CHECK(connection.beginRequest("POST /bot123:abc/sendMessage", 50, body));
+	CHECK(pollUntilDone(connection, 1000) == CTBotRequestError);
+	CHECK(server.getRequestCount() == 5);
+
+	// a new connection is never retried
+	server.replyClose();
+	CHECK(connection.beginRequest("POST /bot123:abc/sendMessage", 1000, body));
+	CHECK(pollUntilDone(connection, 1000) == CTBotRequestError);
+	CHECK(server.getRequestCount() == 6);
+}
+
+static void testChunked()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+	connection.useKeepAlive(true);
+
+	server.replyChunked(okResponse, 7);
+	CHECK(connection.send("GET /bot123:abc/getMe") == okResponse);
+
+	// the whole chunked body has been read: the connection can be reused
+	server.replyChunked(okResponse, 100);
+	connection.beginRequest("GET /bot123:abc/getMe", 1000);
+	CHECK(pollUntilDone(connection, 1000) == CTBotRequestDone);
+	CHECK(connection.takeResponse() == okResponse);
+	CHECK(server.getConnectCount() == 1);
+}
+
+static void testAsyncPartialChunks()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+	connection.useKeepAlive(true);
+
+	String json = okResponse;
+	String response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+	response += String(json.length() / 2, HEX) + "\r\n" + json.substring(0, json.length() / 2) + "\r\n";
+	response += String(json.length() - json.length() / 2, HEX) + ";name=value\r\n" + json.substring(json.length() / 2) + "\r\n";
+	response += "0\r\nX-Trailer: 1\r\n\r\n";
+
+	// the response stops at every byte: poll() never waits for the rest
+	bool isWaiting = false;
+	for (size_t i = 1; i < response.length(); i++) {
+		server.replyRaw(response);
+		server.holdAfter(i);
+		connection.beginRequest("GET /bot123:abc/getMe", 1000);
+		uint32_t start = millis();
+		CTBotRequestState state = connection.poll(5);
+		state = connection.poll(5);
+		if ((millis() - start > 100) || (state == CTBotRequestDone) || (state == CTBotRequestError))
+			isWaiting = true;
+		server.release();
+		CHECK(pollUntilDone(connection, 1000) == CTBotRequestDone);
+		CHECK(connection.takeResponse() == json);
+	}
+	CHECK(!isWaiting);
+	// the whole chunked body and the trailer have been read: the connection is reused
+	CHECK(server.getConnectCount() == 1);
+}
+
+static void testAsyncTimeout()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+
+	server.replyNothing();
+	CHECK(connection.beginRequest("GET /bot123:abc/getMe", 50));
+	CHECK(connection.isBusy());
+	// only one request at a time
+	CHECK(!connection.beginRequest("GET /bot123:abc/getMe", 50));
+	CHECK(pollUntilDone(connection, 1000) == CTBotRequestError);
+	CHECK(!connection.isBusy());
+	CHECK(connection.takeResponse() == "");
+}
+
+static void testResolvedEndpoint()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+
+	// the fixed IP is connected by address
+	server.reply(okResponse);
+	CHECK(connection.send("GET /bot123:abc/getMe") == okResponse);
+	CHECK(server.getConnectHost() == "");
+
+	// the resolved address is connected by name, so the TLS handshake sends the SNI
+	WiFi.setHostAddress(IPAddress(10, 0, 0, 1));
+	connection.useDNS(true);
+	server.reply(okResponse);
+	CHECK(connection.send("GET /bot123:abc/getMe") == okResponse);
+	CHECK(server.getConnectHost() == "api.telegram.org");
+	WiFi.setHostAddress(IPAddress());
+}
+
+static void testCircuitBreaker()
+{
+	FakeTelegramServer server;
+	CTBotSecureConnection connection;
+	connection.setTransport(&server);
+
+	server.setReachable(false);
+	for (uint8_t i = 0; i < CTBOT_CIRCUIT_THRESHOLD; i++) {
+		CHECK(connection.getCircuitState() == CTBotCircuitClosed);
+		CHECK(connection.send("GET /bot123:abc/getMe") == "");
+	}
+	CHECK(connection.getCircuitState() == CTBotCircuitOpen);
+	CHECK(connection.getCircuitRetryDelay() > 0);
+	CHECK(connection.getCircuitRetryDelay() <= CTBOT_CIRCUIT_BACKOFF);
+
+	// fail fast: the server is not even contacted
+	server.setReachable(true);
+	server.reply(okResponse);
+	CHECK(connection.send("GET /bot123:abc/getMe") == "");
+	CHECK(server.getRequestCount() == 0);
+
+	// the backoff expires: the probe request closes the circuit
+	hostAdvanceTime(CTBOT_CIRCUIT_BACKOFF + 1);
+	CHECK(connection.getCircuitRetryDelay() == 0);
+	CHECK(connection.send("GET /bot123:abc/getMe") == okResponse);
+	CHECK(connection.getCircuitState() == CTBotCircuitClosed);
+}
+
+int main()
+{
+	RUN_TEST(testSend);
+	RUN_TEST(testSendText);
+	RUN_TEST(testPostBody);
+	RUN_TEST(testKeepAlive);
+	RUN_TEST(testNoDuplicate);
+	RUN_TEST(testAsyncKeepAlive);
+	RUN_TEST(testChunked);
+	RUN_TEST(testAsyncPartialChunks);
+	RUN_TEST(testAsyncTimeout);
+	RUN_TEST(testResolvedEndpoint);
+	RUN_TEST(testCircuitBreaker);
+	return TEST_RESULT();
+}
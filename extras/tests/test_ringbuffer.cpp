@@ -0,0 +1,71 @@
+// CTBotRingBuffer: single producer/single consumer, with two std::thread
+#include <thread>
+#include "CTBotRingBuffer.h"
+#include "Arduino.h"
+#include "test.h"
+
+static void testFifo()
+{
+	CTBotRingBuffer<String, 3> ring;
+	String item;
+
+	CHECK(ring.isEmpty());
+	CHECK(!ring.pop(item));
+	for (uint8_t i = 0; i < 3; i++) {
+		item = String(i);
+		CHECK(ring.push(item));
+	}
+	CHECK(ring.isFull());
+	CHECK(ring.size() == 3);
+	item = "3";
+	CHECK(!ring.push(item));
+	CHECK(item == "3"); // a rejected item is left untouched
+
+	for (uint8_t i = 0; i < 3; i++) {
+		CHECK(ring.pop(item));
+		CHECK(item == String(i));
+	}
+	CHECK(ring.isEmpty());
+}
+
+static void testThreads()
+{
+	const uint32_t count = 200000;
+	CTBotRingBuffer<String, 8> ring;
+	uint32_t received = 0;
+	bool isOrdered = true;
+
+	std::thread producer([&ring]() {
+		for (uint32_t i = 0; i < count; i++) {
+			String item(i);
+			while (!ring.push(item))
+				std::this_thread::yield();
+		}
+	});
+	std::thread consumer([&ring, &received, &isOrdered]() {
+		String item;
+		while (received < count) {
+			if (!ring.pop(item)) {
+				std::this_thread::yield();
+				continue;
+			}
+			// every item is received once, in order
+			if (item != String(received))
+				isOrdered = false;
+			received++;
+		}
+	});
+	producer.join();
+	consumer.join();
+
+	CHECK(received == count);
+	CHECK(isOrdered);
+	CHECK(ring.isEmpty());
+}
+
+int main()
+{
+	RUN_TEST(testFifo);
+	RUN_TEST(testThreads);
+	return TEST_RESULT();
+}
@@ -3,84 +3,418 @@
 // for decoding UTF8/UNICODE
 #define ARDUINOJSON_DECODE_UNICODE 1 
 #include <ArduinoJson.h>
+#include <utility>
 #include "CTBot.h"
 #include "Utilities.h"
 
 CTBot::CTBot() {
 	m_lastUpdate          = 0;  // not updated yet
 	m_UTF8Encoding        = false; // no UTF8 encoded string conversion
+	m_pollingTimeout      = 0;  // short polling
+	m_updatesLimit        = CTBOT_UPDATES_BATCH_SIZE;
+	m_queueHead           = 0;
+	m_queueCount          = 0;  // no queued messages
+	m_asyncHead           = 0;
+	m_asyncCount          = 0;  // no asynchronous requests
+	m_isAsyncRunning      = false;
+	m_isUpdatePending     = false;
+	m_messageCallback     = NULL;
+	m_sendCallback        = NULL;
+	m_router              = NULL;  // no command router
+	m_outboxCount         = 0;  // no outbound messages
+	m_outboxDrops         = 0;
+	m_globalTokens        = CTBOT_OUTBOX_GLOBAL_RATE * 1000; // full bucket
+	m_lastRefill          = millis();
+	for (uint8_t i = 0; i < CTBOT_OUTBOX_CHATS; i++) {
+		m_chatRates[i].id       = 0;
+		m_chatRates[i].nextSend = 0;
+	}
 }
 
-CTBot::~CTBot() = default;
+CTBot::~CTBot() {
+#if defined(ARDUINO_ARCH_ESP32)
+	stopBackgroundTask();
+#endif
+}
 
 void CTBot::setTelegramToken(String token)
 {	m_token = token;}
 
-String CTBot::sendCommand(String command, String parameters)
+String CTBot::getRequestLine(const String& command, const String& parameters, const char* method) const
 {
-
 	// must filter command + parameters from escape sequences and spaces
-	const String URL = (String)"GET /bot" + m_token + (String)"/" + command + parameters;
+	return (String)method + (String)" /bot" + m_token + (String)"/" + command + parameters;
+}
+
+// counts the written bytes (to measure a body before sending it)
+class CTBotLengthCounter : public Print
+{
+public:
+	size_t write(uint8_t) override { return 1; }
+	size_t write(const uint8_t*, size_t size) override { return size; }
+};
+
+// appends the written bytes to a String
+class CTBotStringWriter : public Print
+{
+public:
+	explicit CTBotStringWriter(String& string) : m_string(string) {}
+	size_t write(uint8_t value) override { m_string += (char)value; return 1; }
+	using Print::write;
+
+private:
+	String& m_string;
+};
+
+// the JSON body of a sendMessage POST request (or of a webhook reply, with the method field).
+// The strings are referenced, not copied: the message and the keyboard must outlive the body.
+// A keyboard stored in flash (see CTBotStaticKeyboard.h) is sent straight from the flash
+class CTBotMessageBody : public Printable
+{
+public:
+	CTBotMessageBody(int64_t id, const String& message, const String& keyboard, const __FlashStringHelper* flashKeyboard = NULL, const char* method = NULL)
+		: m_id(id), m_keyboard(keyboard), m_flashKeyboard(flashKeyboard), m_method(method) {
+#if ARDUINOJSON_VERSION_MAJOR == 5
+		m_text = message.c_str();
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+		m_text.set(message.c_str());
+#endif
+	}
+
+	// the serialized body length (Content-Length)
+	size_t length() const {
+		CTBotLengthCounter counter;
+		return printTo(counter);
+	}
+
+	// serialize the body into a String (for the asynchronous requests)
+	void toString(String& json) const {
+		json.reserve(json.length() + length());
+		CTBotStringWriter writer(json);
+		printTo(writer);
+	}
 
+	size_t printTo(Print& output) const override {
+		size_t length = output.print('{');
+		if (m_method != NULL) {
+			length += output.print("\"method\":\"");
+			length += output.print(m_method);
+			length += output.print("\",");
+		}
+		length += output.print("\"chat_id\":");
+		length += output.print(int64ToAscii(m_id));
+		// the text is escaped by ArduinoJson
+		length += output.print(",\"text\":");
+#if ARDUINOJSON_VERSION_MAJOR == 5
+		length += m_text.printTo(output);
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+		length += serializeJson(m_text, output);
+#endif
+		// the keyboard is already serialized
+		if (m_flashKeyboard != NULL) {
+			length += output.print(",\"reply_markup\":");
+			length += output.print(m_flashKeyboard);
+		}
+		else if (m_keyboard.length() != 0) {
+			length += output.print(",\"reply_markup\":");
+			length += output.print(m_keyboard);
+		}
+		length += output.print('}');
+		return length;
+	}
+
+private:
+	int64_t                    m_id;
+	const String&              m_keyboard;
+	const __FlashStringHelper* m_flashKeyboard;
+	const char*                m_method;
+#if ARDUINOJSON_VERSION_MAJOR == 5
+	JsonVariant                m_text;
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	StaticJsonDocument<16>     m_text; // only a reference to the message
+#endif
+};
+
+String CTBot::sendCommand(String command, String parameters)
+{
 	// send the HTTP request
-	return(m_connection.send(URL));
-}
-
-String CTBot::toUTF8(String message) const
-{
-	String converted("");
-	uint16_t i = 0;
-	while (i < message.length()) {
-		String subMessage(message[i]);
-		if (message[i] != '\\') {
-			converted += subMessage;
-			i++;
-		} else {
-			// found "\"
-			i++;
-			if (i == message.length()) {
-				// no more characters
-				converted += subMessage;
-			} else {
-				subMessage += (String)message[i];
-				if (message[i] != 'u') {
-					converted += subMessage;
-					i++;
-				} else {
-					//found \u escape code
-					i++;
-					if (i == message.length()) {
-						// no more characters
-						converted += subMessage;
-					} else {
-						uint8_t j = 0;
-						while ((j < 4) && ((j + i) < message.length())) {
-							subMessage += (String)message[i + j];
-							j++;
-						}
-						i += j;
-						String utf8;
-						if (unicodeToUTF8(subMessage, utf8))
-							converted += utf8;
-						else
-							converted += subMessage;
-					}
-				}
-			}
+	return(m_connection.send(getRequestLine(command, parameters)));
+}
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+// ArduinoJson filters: only the fields used by CTBot are stored in the JSON document.
+// Every filter is built only once, the first time it is used
+
+// the error fields of every Telegram response
+static void addErrorFilter(JsonDocument& filter)
+{
+	filter["ok"]          = true;
+	filter["description"] = true;
+	filter["error_code"]  = true;
+	filter["parameters"]  = true;
+}
+
+// the fields mapped into TBUser (and TBUserView)
+static void addUserFilter(JsonObject user)
+{
+	user["id"]            = true;
+	user["is_bot"]        = true;
+	user["username"]      = true;
+	user["first_name"]    = true;
+	user["last_name"]     = true;
+	user["language_code"] = true;
+}
+
+// the fields of an update mapped into TBMessage
+static void addUpdateFilter(JsonObject update)
+{
+	update["update_id"] = true;
+
+	JsonObject message = update.createNestedObject("message");
+	message["message_id"] = true;
+	message["date"]       = true;
+	message["text"]       = true;
+	addUserFilter(message.createNestedObject("from"));
+	JsonObject chat = message.createNestedObject("chat");
+	chat["id"]    = true;
+	chat["title"] = true;
+	JsonObject location = message.createNestedObject("location");
+	location["longitude"] = true;
+	location["latitude"]  = true;
+	JsonObject contact = message.createNestedObject("contact");
+	contact["user_id"]      = true;
+	contact["first_name"]   = true;
+	contact["last_name"]    = true;
+	contact["phone_number"] = true;
+	contact["vcard"]        = true;
+
+	JsonObject query = update.createNestedObject("callback_query");
+	query["id"]            = true;
+	query["data"]          = true;
+	query["chat_instance"] = true;
+	addUserFilter(query.createNestedObject("from"));
+	JsonObject queryMessage = query.createNestedObject("message");
+	queryMessage["message_id"] = true;
+	queryMessage["text"]       = true;
+	queryMessage["date"]       = true;
+}
+
+// getUpdates: the fields mapped into TBMessage
+static const JsonDocument& getUpdatesFilter()
+{
+	static StaticJsonDocument<JSON_OBJECT_SIZE(5) + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(3) +
+		JSON_OBJECT_SIZE(7) + 2 * JSON_OBJECT_SIZE(6) + 2 * JSON_OBJECT_SIZE(2) + 2 * JSON_OBJECT_SIZE(5) +
+		JSON_OBJECT_SIZE(3)> filter;
+
+	if (filter.isNull()) {
+		addErrorFilter(filter);
+		addUpdateFilter(filter.createNestedArray("result").createNestedObject());
+	}
+	return filter;
+}
+
+// webhook: a single update, the fields mapped into TBMessage
+static const JsonDocument& getWebhookFilter()
+{
+	static StaticJsonDocument<JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(7) + 2 * JSON_OBJECT_SIZE(6) +
+		2 * JSON_OBJECT_SIZE(2) + 2 * JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(3)> filter;
+
+	if (filter.isNull())
+		addUpdateFilter(filter.to<JsonObject>());
+	return filter;
+}
+
+// getMe: the fields mapped into TBUser
+static const JsonDocument& getMeFilter()
+{
+	static StaticJsonDocument<JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(6)> filter;
+
+	if (filter.isNull()) {
+		addErrorFilter(filter);
+		addUserFilter(filter.createNestedObject("result"));
+	}
+	return filter;
+}
+
+// getUpdates: only the update ID (to skip an update that doesn't fit the JSON document)
+static const JsonDocument& getUpdateIDFilter()
+{
+	static StaticJsonDocument<JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(1)> filter;
+
+	if (filter.isNull())
+		filter.createNestedArray("result").createNestedObject()["update_id"] = true;
+	return filter;
+}
+
+// sendMessage, answerCallbackQuery...: only the outcome of the command (the echoed message is dropped)
+static const JsonDocument& getResultFilter()
+{
+	static StaticJsonDocument<JSON_OBJECT_SIZE(4)> filter;
+
+	if (filter.isNull())
+		addErrorFilter(filter);
+	return filter;
+}
+
+DeserializationError CTBot::deserializeCommand(JsonDocument& root, const JsonDocument& filter, const String& command, const String& parameters, const String& text)
+{
+	// the UTF8 conversion needs the whole response
+	if (m_UTF8Encoding) {
+		String response = m_connection.send(getRequestLine(command, parameters), text);
+		toUTF8(response);
+		return parseResponse(root, response, filter);
+	}
+
+	// parse the JSON straight from the connection: no copy of the response is stored
+	if (!m_connection.sendRequest(getRequestLine(command, parameters), text))
+		return DeserializationError::IncompleteInput;
+	DeserializationError error = parseResponse(root, m_connection.getResponseStream(), filter);
+	m_connection.endResponse();
+	return error;
+}
+
+DeserializationError CTBot::deserializeCommand(JsonDocument& root, const JsonDocument& filter, const String& command, const Printable& body, size_t length)
+{
+	String request = getRequestLine(command, "", "POST");
+
+	// the UTF8 conversion needs the whole response
+	if (m_UTF8Encoding) {
+		String response = m_connection.send(request, body, length);
+		toUTF8(response);
+		return parseResponse(root, response, filter);
+	}
+
+	if (!m_connection.sendRequest(request, body, length))
+		return DeserializationError::IncompleteInput;
+	DeserializationError error = parseResponse(root, m_connection.getResponseStream(), filter);
+	m_connection.endResponse();
+	return error;
+}
+
+template <typename T>
+DeserializationError CTBot::parseResponse(JsonDocument& root, T& input, const JsonDocument& filter)
+{
+	CTBOT_STATS_START(start);
+	DeserializationError error = deserializeJson(root, input, DeserializationOption::Filter(filter));
+	CTBOT_STATS_RECORD(m_connection.getStats(), CTBotStatsParse, start);
+	if (error)
+		CTBOT_STATS_ERROR(m_connection.getStats(), CTBotStatsErrorJSON);
+	return error;
+}
+
+DeserializationError CTBot::deserializeWebhook(JsonDocument& root)
+{
+	m_viewCount = 0; // the document is reused
+
+	// the UTF8 conversion needs the whole body
+	if (m_UTF8Encoding) {
+		String body;
+		if (!m_webhook.readBody(body))
+			return DeserializationError::IncompleteInput;
+		toUTF8(body);
+		return parseResponse(root, body, getWebhookFilter());
+	}
+	return parseResponse(root, m_webhook.getBodyStream(), getWebhookFilter());
+}
+
+void CTBot::skipUpdate(const String& response)
+{
+	StaticJsonDocument<CTBOT_JSON6_RESULT_BUFFER_SIZE> root;
+	DeserializationError error;
+	if (response.length() != 0)
+		error = parseResponse(root, response, getUpdateIDFilter());
+	else
+		error = deserializeCommand(root, getUpdateIDFilter(), "getUpdates", getUpdatesParameters(1));
+	if (error || (0 == root["result"].size()))
+		return;
+
+	int32_t updateID = root["result"][0]["update_id"].as<int32_t>();
+	m_lastUpdate = updateID + 1;
+	serialLog("getUpdates: the update ");
+	serialLog(updateID);
+	serialLog(" doesn't fit the JSON document, skipped\n");
+}
+#endif
+
+void CTBot::toUTF8(String& message) const
+{
+	// a \uXXXX escape sequence is longer than its UTF8 encoding (a 12 characters surrogate
+	// pair is encoded with 4 bytes): the converted message is written over the original one
+	char* buffer = message.begin();
+	uint16_t length = message.length();
+	uint16_t in = 0, out = 0;
+
+	while (in < length) {
+		if ((buffer[in] != '\\') || (in + 1 == length)) {
+			buffer[out++] = buffer[in++];
+			continue;
 		}
+		uint32_t value = 0;
+		uint8_t decoded = 0;
+		if (buffer[in + 1] == 'u')
+			decoded = decodeUnicodeEscape(buffer + in, length - in, value);
+		if ((0 == decoded) || (value < 0x20) || ('"' == value) || ('\\' == value)) {
+			// not converted: copy the escape sequence (i.e. \" or \\) and go on
+			buffer[out++] = buffer[in++];
+			buffer[out++] = buffer[in++];
+			continue;
+		}
+		out += codePointToUTF8(value, buffer + out);
+		in += decoded;
 	}
-	return converted;
+	if (out < length)
+		message.remove(out);
 }
 
 void CTBot::enableUTF8Encoding(bool value) 
 {	m_UTF8Encoding = value;}
 
+void CTBot::setPollingTimeout(uint16_t timeout)
+{	m_pollingTimeout = timeout;}
+
+void CTBot::useKeepAlive(bool value)
+{	m_connection.useKeepAlive(value);}
+
+uint32_t CTBot::getHandshakeCount() const
+{	return m_connection.getHandshakeCount();}
+
+uint32_t CTBot::getReconnectCount() const
+{	return m_connection.getReconnectCount();}
+
+uint32_t CTBot::getResumedHandshakeCount() const
+{	return m_connection.getResumedHandshakeCount();}
+
+CTBotCircuitState CTBot::getCircuitState() const
+{	return m_connection.getCircuitState();}
+
+uint32_t CTBot::getCircuitRetryDelay() const
+{	return m_connection.getCircuitRetryDelay();}
+
+bool CTBot::reconnect()
+{
+	if (!m_wifi.reconnect())
+		return false;
+	m_connection.resetCircuit();
+	return true;
+}
+
+bool CTBot::addEndpoint(const String& ip)
+{	return m_connection.addEndpoint(ip);}
+
+void CTBot::setTransport(Client* client)
+{	m_connection.setTransport(client);}
+
 bool CTBot::testConnection(){
 	TBUser user;
 	return getMe(user);
 }
 
 bool CTBot::getMe(TBUser &user) {
+	if (isForeignTask())
+		return false;
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
 #if CTBOT_BUFFER_SIZE > 0
@@ -90,14 +424,15 @@ bool CTBot::getMe(TBUser &user) {
 #endif
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DynamicJsonDocument root(CTBOT_JSON6_BUFFER_SIZE);
+	JsonDocument& root = m_jsonDocument;
 #endif
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
 	JsonObject& root = jsonBuffer.parse(sendCommand("getMe"));
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DeserializationError error = deserializeJson(root, sendCommand("getMe"));
+	m_viewCount = 0; // the document is reused
+	DeserializationError error = deserializeCommand(root, getMeFilter(), "getMe");
 	if (error) {
 		serialLog("getNewMessage error: ArduinoJson deserialization error code: ");
 		serialLog(error.c_str());
@@ -107,6 +442,7 @@ bool CTBot::getMe(TBUser &user) {
 #endif
 
 	if (!root["ok"]) {
+		CTBOT_STATS_ERROR(m_connection.getStats(), CTBotStatsErrorServer);
 #if CTBOT_DEBUG_MODE > 0
 		serialLog("getMe error:\n");
 #if ARDUINOJSON_VERSION_MAJOR == 5
@@ -139,128 +475,555 @@ bool CTBot::getMe(TBUser &user) {
 }
 
 CTBotMessageType CTBot::getNewMessage(TBMessage& message) {
-	char buf[21];
+	message.messageType = CTBotMessageNoData;
+
+#if defined(ARDUINO_ARCH_ESP32)
+	// the messages are received by the background task
+	if (isForeignTask()) {
+		while (m_inboundRing.pop(message)) {
+			if ((NULL == m_router) || !m_router->dispatch(message))
+				return message.messageType;
+		}
+		message.messageType = CTBotMessageNoData;
+		return message.messageType;
+	}
+#endif
+
+	// answer the webhook request of the previous message, with its reply (if any)
+	m_webhook.releaseRequest();
+
+	// the queued messages are served first, without any network activity
+	if (m_webhook.isRunning())
+		pollWebhook();
+	else if (0 == m_queueCount)
+		fetchUpdates();
+	while (popMessage(message)) {
+		// the routed messages are consumed: serve the next queued one
+		if ((NULL == m_router) || !m_router->dispatch(message))
+			return message.messageType;
+		m_webhook.releaseRequest();
+	}
+	message.messageType = CTBotMessageNoData;
+	return message.messageType;
+}
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+CTBotMessageType CTBot::getNewMessage(TBMessageView& message) {
+	JsonDocument& root = m_jsonDocument;
+	message.messageType = CTBotMessageNoData;
+	if (isForeignTask())
+		return CTBotMessageNoData;
+
+	// the queued messages can't be referenced by a view: they are left for getNewMessage(TBMessage&)
+	if (hasQueuedMessages()) {
+		serialLog("getNewMessage: messages queued, read them with getNewMessage(TBMessage&)\n");
+		return CTBotMessageNoData;
+	}
+
+	// answer the webhook request of the previous message, with its reply (if any)
+	m_webhook.releaseRequest();
+
+	// webhook: the update of a single request is read
+	if (m_webhook.isRunning()) {
+		pollWebhook(&message);
+		if (CTBotMessageNoData == message.messageType)
+			return CTBotMessageNoData;
+		// the routed messages are consumed
+		if ((NULL == m_router) || !m_router->dispatch(message))
+			return message.messageType;
+		m_webhook.releaseRequest();
+		message.messageType = CTBotMessageNoData;
+		return message.messageType;
+	}
+
+	if (m_viewNext >= m_viewCount) {
+		// the previous batch has been read (or the document has been reused): fetch a new one
+		m_viewNext = 0;
+		if (!requestUpdates(m_updatesLimit) || !checkUpdates(root))
+			return CTBotMessageNoData;
+
+		m_viewCount = root["result"].size();
+		// the backlog is drained: the full batch size can be used again
+		if (m_viewCount < m_updatesLimit)
+			m_updatesLimit = CTBOT_UPDATES_BATCH_SIZE;
+	}
 
+	while (m_viewNext < m_viewCount) {
+		JsonVariant update = root["result"][m_viewNext++];
+
+		// the updates are marked as read one at a time: if the document is reused
+		// before the whole batch has been read, the unread ones are fetched again
+		m_lastUpdate = update["update_id"].as<int32_t>() + 1;
+
+		// unhandled updates are skipped, but still marked as read
+		CTBOT_STATS_START(start);
+		CTBotMessageType type = parseUpdate(update, message);
+		CTBOT_STATS_RECORD(m_connection.getStats(), CTBotStatsExtract, start);
+		if (CTBotMessageNoData == type)
+			continue;
+		// the routed messages are consumed
+		if ((NULL == m_router) || !m_router->dispatch(message))
+			return message.messageType;
+	}
 	message.messageType = CTBotMessageNoData;
+	return message.messageType;
+}
+#endif
+
+bool CTBot::hasQueuedMessages() const {
+#if defined(ARDUINO_ARCH_ESP32)
+	if (!m_isTaskRunning && !m_inboundRing.isEmpty())
+		return true;
+#endif
+	return m_queueCount > 0;
+}
+
+bool CTBot::popMessage(TBMessage& message) {
+#if defined(ARDUINO_ARCH_ESP32)
+	// the messages left by a stopped background task come first
+	if (!m_isTaskRunning && m_inboundRing.pop(message))
+		return true;
+#endif
+	return popReceivedMessage(message);
+}
+
+bool CTBot::popReceivedMessage(TBMessage& message) {
+	if (0 == m_queueCount)
+		return false;
+
+	message = std::move(m_updatesQueue[m_queueHead]);
+	m_queueHead = (m_queueHead + 1) % CTBOT_UPDATES_QUEUE_SIZE;
+	m_queueCount--;
+	return true;
+}
+
+uint8_t CTBot::getUpdatesLimit() const {
+	// fetch no more updates than the free slots of the queue
+	uint8_t limit = CTBOT_UPDATES_QUEUE_SIZE - m_queueCount;
+	if (limit > m_updatesLimit)
+		limit = m_updatesLimit;
+	return limit;
+}
+
+String CTBot::getUpdatesParameters(uint8_t limit) const {
+	char buf[21];
+
+	ltoa(m_lastUpdate, buf, 10);
+	String parameters = (String)"?limit=" + (String)limit + (String)"&allowed_updates=message,callback_query";
+
+	if (m_lastUpdate != 0)
+		parameters += (String)"&offset=" + (String)buf;
+
+	// long polling: the server answers as soon as a message arrives or when the timeout expires
+	if (m_pollingTimeout != 0)
+		parameters += (String)"&timeout=" + (String)m_pollingTimeout;
+	return parameters;
+}
+
+bool CTBot::fetchUpdates() {
+	uint8_t limit = getUpdatesLimit();
+	if (0 == limit)
+		return false;
+
+#if ARDUINOJSON_VERSION_MAJOR == 5
+#if CTBOT_BUFFER_SIZE > 0
+	StaticJsonBuffer<CTBOT_JSON5_BUFFER_SIZE> jsonBuffer;
+#else
+	DynamicJsonBuffer jsonBuffer;
+#endif
+
+	// the server holds the request up to m_pollingTimeout seconds: wait for it
+	m_connection.setResponseTimeout(CTBOT_RESPONSE_TIMEOUT + (uint32_t)m_pollingTimeout * 1000);
+	String response = sendCommand("getUpdates", getUpdatesParameters(limit));
+	m_connection.setResponseTimeout(CTBOT_RESPONSE_TIMEOUT);
+	if (m_UTF8Encoding)
+		toUTF8(response);
+	JsonObject& root = jsonBuffer.parse(response);
+	return storeUpdates(root, limit);
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	if (!requestUpdates(limit))
+		return false;
+	return storeUpdates(m_jsonDocument, limit);
+#endif
+}
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+bool CTBot::requestUpdates(uint8_t limit) {
+	m_viewCount = 0; // the document is reused
+
+	// the server holds the request up to m_pollingTimeout seconds: wait for it
+	m_connection.setResponseTimeout(CTBOT_RESPONSE_TIMEOUT + (uint32_t)m_pollingTimeout * 1000);
+	DeserializationError error = deserializeCommand(m_jsonDocument, getUpdatesFilter(), "getUpdates", getUpdatesParameters(limit));
+	m_connection.setResponseTimeout(CTBOT_RESPONSE_TIMEOUT);
+
+	if (error) {
+		handleUpdatesError(error, limit);
+		return false;
+	}
+	return true;
+}
+
+void CTBot::handleUpdatesError(DeserializationError error, uint8_t limit, const String& response) {
+	serialLog("getNewMessage error: ArduinoJson deserialization error code: ");
+	serialLog(error.c_str());
+	serialLog("\n");
+	// the batch doesn't fit the JSON document: ask for fewer updates next time
+	if (error.code() == DeserializationError::NoMemory) {
+		if (m_updatesLimit > 1)
+			m_updatesLimit /= 2;
+		if (1 == limit)
+			skipUpdate(response);
+	}
+}
+#endif
+
+template <typename T>
+bool CTBot::checkUpdates(T& root) {
+	if (!root["ok"]) {
+		CTBOT_STATS_ERROR(m_connection.getStats(), CTBotStatsErrorServer);
+#if CTBOT_DEBUG_MODE > 0
+		serialLog("getNewMessage error: ");
+#if ARDUINOJSON_VERSION_MAJOR == 5
+		root.prettyPrintTo(Serial);
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+		serializeJsonPretty(root, Serial);
+#endif
+		serialLog("\n");
+#endif
+		return false;
+	}
+
+#if CTBOT_DEBUG_MODE > 0
+	serialLog("getNewMessage JSON: ");
+#if ARDUINOJSON_VERSION_MAJOR == 5
+	root.prettyPrintTo(Serial);
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	serializeJsonPretty(root, Serial);
+#endif
+	serialLog("\n");
+#endif
+	return true;
+}
+
+template <typename T>
+bool CTBot::storeUpdates(T& root, uint8_t limit) {
+	if (!checkUpdates(root))
+		return false;
+
+	uint8_t updates = root["result"].size();
+	uint32_t lastUpdateID = 0;
+	CTBOT_STATS_START(start);
+	for (uint8_t i = 0; i < updates; i++) {
+		JsonVariant update = root["result"][i];
+		lastUpdateID = update["update_id"].as<int32_t>();
+
+		// unhandled updates are skipped, but still marked as read
+		TBMessage& slot = m_updatesQueue[(m_queueHead + m_queueCount) % CTBOT_UPDATES_QUEUE_SIZE];
+		slot = TBMessage();
+		if (parseUpdate(update, slot) != CTBotMessageNoData)
+			m_queueCount++;
+	}
+	CTBOT_STATS_RECORD(m_connection.getStats(), CTBotStatsExtract, start);
+	if (0 == lastUpdateID)
+		return false;
+
+	// the offset advances once for the whole batch
+	m_lastUpdate = lastUpdateID + 1;
+
+	// the backlog is drained: the full batch size can be used again
+	if (updates < limit)
+		m_updatesLimit = CTBOT_UPDATES_BATCH_SIZE;
+	return true;
+}
+
+bool CTBot::isNewUpdate(JsonVariant update) {
+	int32_t updateID = update["update_id"].as<int32_t>();
+
+	// the server sends an update again if it didn't get the answer: skip it
+	if (updateID < m_lastUpdate)
+		return false;
+	m_lastUpdate = updateID + 1;
+	return true;
+}
+
+void CTBot::storeUpdate(JsonVariant update) {
+	if (!isNewUpdate(update))
+		return;
+
+	// unhandled updates are skipped, but still marked as read
+	CTBOT_STATS_START(start);
+	TBMessage& slot = m_updatesQueue[(m_queueHead + m_queueCount) % CTBOT_UPDATES_QUEUE_SIZE];
+	slot = TBMessage();
+	if (parseUpdate(update, slot) != CTBotMessageNoData)
+		m_queueCount++;
+	CTBOT_STATS_RECORD(m_connection.getStats(), CTBotStatsExtract, start);
+}
+
+bool CTBot::executeCommand(const String& command, const String& parameters)
+{
+	if (isForeignTask())
+		return false;
+
+#if ARDUINOJSON_VERSION_MAJOR == 5
+#if CTBOT_BUFFER_SIZE > 0
+	StaticJsonBuffer<CTBOT_JSON5_BUFFER_SIZE> jsonBuffer;
+#else
+	DynamicJsonBuffer jsonBuffer;
+#endif
+	JsonObject& root = jsonBuffer.parse(sendCommand(command, parameters));
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	// only the outcome is stored: the received messages in m_jsonDocument are not overwritten
+	StaticJsonDocument<CTBOT_JSON6_RESULT_BUFFER_SIZE> root;
+	DeserializationError error = deserializeCommand(root, getResultFilter(), command, parameters);
+	if (error) {
+		serialLog(command);
+		serialLog(" error: ArduinoJson deserialization error code: ");
+		serialLog(error.c_str());
+		serialLog("\n");
+		return false;
+	}
+#endif
+
+	if (!root["ok"]) {
+		CTBOT_STATS_ERROR(m_connection.getStats(), CTBotStatsErrorServer);
+#if CTBOT_DEBUG_MODE > 0
+		serialLog(command);
+		serialLog(" error: ");
+#if ARDUINOJSON_VERSION_MAJOR == 5
+		root.prettyPrintTo(Serial);
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+		serializeJsonPretty(root, Serial);
+#endif
+		serialLog("\n");
+#endif
+		return false;
+	}
+	return true;
+}
+
+bool CTBot::setWebhook(const String& url, const String& secretToken)
+{
+	if (!m_webhook.setSecretToken(secretToken))
+		return false;
+
+	// one update at a time: the webhook server handles a single request
+	String parameters = (String)"?max_connections=1&allowed_updates=message,callback_query&url=";
+	URLEncodeMessage(url, parameters);
+	if (secretToken.length() != 0)
+		parameters += (String)"&secret_token=" + secretToken;
+	return executeCommand("setWebhook", parameters);
+}
+
+bool CTBot::deleteWebhook()
+{	return executeCommand("deleteWebhook", "");}
+
+bool CTBot::startWebhookServer(uint16_t port)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+	// the background task polls the updates with getUpdates
+	if (m_isTaskRunning)
+		return false;
+#endif
+	m_webhook.begin(port);
+	return true;
+}
+
+void CTBot::stopWebhookServer()
+{	m_webhook.end();}
+
+void CTBot::pollWebhook(TBMessageView* view)
+{
+	// the server sends the next update only when the current one is answered
+	if (m_webhook.isRequestHeld())
+		return;
+	Client* client = m_webhook.accept();
+	if (NULL == client)
+		return;
+
+	// the request of the message that will be read next is held open until the message
+	// is handled, so the answer can carry its reply (see replyMessage())
+	uint8_t queued = m_queueCount;
+	uint16_t status = storeWebhookUpdate(*client, view);
+	bool isNext = (NULL == view) ? ((0 == queued) && (1 == m_queueCount)) : (view->messageType != CTBotMessageNoData);
+	if ((200 == status) && isNext)
+		m_webhook.holdRequest(*client);
+	else
+		m_webhook.endRequest(*client, status);
+}
+
+bool CTBot::handleWebhookRequest(Client& client)
+{
+	uint16_t status = storeWebhookUpdate(client);
+	m_webhook.endRequest(client, status);
+	return 200 == status;
+}
+
+bool CTBot::replyMessage(int64_t id, String message, String keyboard)
+{
+	// only the first reply fits the answer to the webhook request
+	if ((0 == message.length()) || !m_webhook.canReply())
+		return sendMessage(id, message, keyboard);
+
+	String reply;
+	CTBotMessageBody(id, message, keyboard, NULL, "sendMessage").toString(reply);
+	return m_webhook.setReply(reply);
+}
+
+bool CTBot::replyMessage(int64_t id, String message, CTBotInlineKeyboard &keyboard)
+{	return replyMessage(id, message, keyboard.getJSON());}
 
-	ltoa(m_lastUpdate, buf, 10);
-	// polling timeout: add &timeout=<seconds>
-	// default is zero (short polling).
-	String parameters = "?limit=1&allowed_updates=message,callback_query";
+bool CTBot::replyMessage(int64_t id, String message, CTBotReplyKeyboard &keyboard)
+{	return replyMessage(id, message, keyboard.getJSON());}
 
-	if (m_lastUpdate != 0)
-		parameters += (String)"&offset=" + (String)buf;
+bool CTBot::replyQuery(String queryID, String message, bool alertMode)
+{
+	if ((0 == queryID.length()) || !m_webhook.canReply())
+		return endQuery(queryID, message, alertMode);
 
+	// the strings are referenced, not copied
+	String reply;
 #if ARDUINOJSON_VERSION_MAJOR == 5
-#if CTBOT_BUFFER_SIZE > 0
-	StaticJsonBuffer<CTBOT_JSON5_BUFFER_SIZE> jsonBuffer;
-#else
-	DynamicJsonBuffer jsonBuffer;
+	StaticJsonBuffer<JSON_OBJECT_SIZE(4)> jsonBuffer;
+	JsonObject& root = jsonBuffer.createObject();
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	StaticJsonDocument<JSON_OBJECT_SIZE(4)> root;
 #endif
+	root["method"]            = "answerCallbackQuery";
+	root["callback_query_id"] = queryID.c_str();
+	if (message.length() != 0) {
+		root["text"]       = message.c_str();
+		root["show_alert"] = alertMode;
+	}
+#if ARDUINOJSON_VERSION_MAJOR == 5
+	root.printTo(reply);
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DynamicJsonDocument root(CTBOT_JSON6_BUFFER_SIZE);
+	serializeJson(root, reply);
 #endif
+	return m_webhook.setReply(reply);
+}
+
+uint16_t CTBot::storeWebhookUpdate(Client& client, TBMessageView* view)
+{
+	uint16_t status = m_webhook.readRequest(client);
+	if (status != 200)
+		return status;
+	// no room for the update: the server sends it again later
+	if (CTBOT_UPDATES_QUEUE_SIZE == m_queueCount)
+		return 503;
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
-	JsonObject& root = jsonBuffer.parse(m_UTF8Encoding ? 
-		toUTF8(sendCommand("getUpdates", parameters)) : 
-		sendCommand("getUpdates", parameters));
+#if CTBOT_BUFFER_SIZE > 0
+	StaticJsonBuffer<CTBOT_JSON5_BUFFER_SIZE> jsonBuffer;
+#else
+	DynamicJsonBuffer jsonBuffer;
+#endif
+	String body;
+	if (!m_webhook.readBody(body))
+		return 400;
+	if (m_UTF8Encoding)
+		toUTF8(body);
+	JsonObject& update = jsonBuffer.parseObject(body);
+	if (!update.success()) {
+		serialLog("Webhook error: invalid update\n");
+		return 400;
+	}
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DeserializationError error = deserializeJson(root, m_UTF8Encoding ? 
-		toUTF8(sendCommand("getUpdates", parameters)) : 
-		sendCommand("getUpdates", parameters));
-
+	DeserializationError error = deserializeWebhook(m_jsonDocument);
 	if (error) {
-		serialLog("getNewMessage error: ArduinoJson deserialization error code: ");
+		serialLog("Webhook error: ArduinoJson deserialization error code: ");
 		serialLog(error.c_str());
 		serialLog("\n");
-		return CTBotMessageNoData;
-    }
+		// the update will never fit the JSON document: drop it, or the server would send it forever
+		return (error.code() == DeserializationError::NoMemory) ? 200 : 400;
+	}
+	JsonVariant update = m_jsonDocument.as<JsonVariant>();
 #endif
 
-	if (!root["ok"]) {
 #if CTBOT_DEBUG_MODE > 0
-		serialLog("getNewMessage error: ");
+	serialLog("Webhook JSON: ");
 #if ARDUINOJSON_VERSION_MAJOR == 5
-		root.prettyPrintTo(Serial);
+	update.prettyPrintTo(Serial);
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-		serializeJsonPretty(root, Serial);
+	serializeJsonPretty(update, Serial);
 #endif
-		serialLog("\n");
+	serialLog("\n");
 #endif
-		return CTBotMessageNoData;
-	}
 
-#if CTBOT_DEBUG_MODE > 0
-	serialLog("getNewMessage JSON: ");
-#if ARDUINOJSON_VERSION_MAJOR == 5
-	root.prettyPrintTo(Serial);
-#endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	serializeJsonPretty(root, Serial);
-#endif
-	serialLog("\n");
+	// the view references the document: the update is not queued
+	if (view != NULL) {
+		if (isNewUpdate(update))
+			parseUpdate(update, *view);
+		return 200;
+	}
 #endif
+	storeUpdate(update);
+	return 200;
+}
 
-	uint32_t updateID = root["result"][0]["update_id"].as<int32_t>();
-	if (0 == updateID)
-		return CTBotMessageNoData;
-	m_lastUpdate = updateID + 1;
+CTBotMessageType CTBot::parseUpdate(JsonVariant update, TBMessage& message) {
+	message.messageType = CTBotMessageNoData;
 
-	if (root["result"][0]["callback_query"]["id"]) {
+	if (update["callback_query"]["id"]) {
 		// this is a callback query
-		message.messageID         = root["result"][0]["callback_query"]["message"]["message_id"].as<int32_t>();
-		message.text              = root["result"][0]["callback_query"]["message"]["text"].as<String>();
-		message.date              = root["result"][0]["callback_query"]["message"]["date"].as<int32_t>();
-		message.sender.id         = root["result"][0]["callback_query"]["from"]["id"].as<int32_t>();
-		message.sender.username   = root["result"][0]["callback_query"]["from"]["username"].as<String>();
-		message.sender.firstName  = root["result"][0]["callback_query"]["from"]["first_name"].as<String>();
-		message.sender.lastName   = root["result"][0]["callback_query"]["from"]["last_name"].as<String>();
-		message.callbackQueryID   = root["result"][0]["callback_query"]["id"].as<String>();
-		message.callbackQueryData = root["result"][0]["callback_query"]["data"].as<String>();
-		message.chatInstance      = root["result"][0]["callback_query"]["chat_instance"].as<String>();
+		message.messageID         = update["callback_query"]["message"]["message_id"].as<int32_t>();
+		message.text              = update["callback_query"]["message"]["text"].as<String>();
+		message.date              = update["callback_query"]["message"]["date"].as<int32_t>();
+		message.sender.id         = update["callback_query"]["from"]["id"].as<int32_t>();
+		message.sender.username   = update["callback_query"]["from"]["username"].as<String>();
+		message.sender.firstName  = update["callback_query"]["from"]["first_name"].as<String>();
+		message.sender.lastName   = update["callback_query"]["from"]["last_name"].as<String>();
+		message.callbackQueryID   = update["callback_query"]["id"].as<String>();
+		message.callbackQueryData = update["callback_query"]["data"].as<String>();
+		message.chatInstance      = update["callback_query"]["chat_instance"].as<String>();
 		message.messageType       = CTBotMessageQuery;
 		return CTBotMessageQuery;
 	}
-	else if (root["result"][0]["message"]["message_id"]) {
+	else if (update["message"]["message_id"]) {
 		// this is a message
-		message.messageID        = root["result"][0]["message"]["message_id"].as<int32_t>();
-		message.sender.id        = root["result"][0]["message"]["from"]["id"].as<int32_t>();
-		message.sender.username  = root["result"][0]["message"]["from"]["username"].as<String>();
-		message.sender.firstName = root["result"][0]["message"]["from"]["first_name"].as<String>();
-		message.sender.lastName  = root["result"][0]["message"]["from"]["last_name"].as<String>();
-		message.group.id         = root["result"][0]["message"]["chat"]["id"].as<int64_t>();
-		message.group.title      = root["result"][0]["message"]["chat"]["title"].as<String>();
-		message.date             = root["result"][0]["message"]["date"].as<int32_t>();
+		message.messageID        = update["message"]["message_id"].as<int32_t>();
+		message.sender.id        = update["message"]["from"]["id"].as<int32_t>();
+		message.sender.username  = update["message"]["from"]["username"].as<String>();
+		message.sender.firstName = update["message"]["from"]["first_name"].as<String>();
+		message.sender.lastName  = update["message"]["from"]["last_name"].as<String>();
+		message.group.id         = update["message"]["chat"]["id"].as<int64_t>();
+		message.group.title      = update["message"]["chat"]["title"].as<String>();
+		message.date             = update["message"]["date"].as<int32_t>();
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
-		if (root["result"][0]["message"]["text"].as<String>().length() != 0) {
+		if (update["message"]["text"].as<String>().length() != 0) {
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-			if (root["result"][0]["message"]["text"]) {
+		if (update["message"]["text"]) {
 #endif
 			// this is a text message
-		    message.text        = root["result"][0]["message"]["text"].as<String>();		    
+			message.text        = update["message"]["text"].as<String>();
 			message.messageType = CTBotMessageText;
 			return CTBotMessageText;
 		}
-		else if (root["result"][0]["message"]["location"]) {
+		else if (update["message"]["location"]) {
 			// this is a location message
-			message.location.longitude = root["result"][0]["message"]["location"]["longitude"].as<float>();
-			message.location.latitude  = root["result"][0]["message"]["location"]["latitude"].as<float>();
+			message.location.longitude = update["message"]["location"]["longitude"].as<float>();
+			message.location.latitude  = update["message"]["location"]["latitude"].as<float>();
 			message.messageType = CTBotMessageLocation;
 			return CTBotMessageLocation;
 		}
-		else if (root["result"][0]["message"]["contact"]) {
+		else if (update["message"]["contact"]) {
 			// this is a contact message
-			message.contact.id          = root["result"][0]["message"]["contact"]["user_id"].as<int32_t>();
-			message.contact.firstName   = root["result"][0]["message"]["contact"]["first_name"].as<String>();
-			message.contact.lastName    = root["result"][0]["message"]["contact"]["last_name"].as<String>();
-			message.contact.phoneNumber = root["result"][0]["message"]["contact"]["phone_number"].as<String>();
-			message.contact.vCard       = root["result"][0]["message"]["contact"]["vcard"].as<String>();
+			message.contact.id          = update["message"]["contact"]["user_id"].as<int32_t>();
+			message.contact.firstName   = update["message"]["contact"]["first_name"].as<String>();
+			message.contact.lastName    = update["message"]["contact"]["last_name"].as<String>();
+			message.contact.phoneNumber = update["message"]["contact"]["phone_number"].as<String>();
+			message.contact.vCard       = update["message"]["contact"]["vcard"].as<String>();
 			message.messageType = CTBotMessageContact;
 			return CTBotMessageContact;
 		}
@@ -269,19 +1032,95 @@ CTBotMessageType CTBot::getNewMessage(TBMessage& message) {
 	return CTBotMessageNoData;
 }
 
-bool CTBot::sendMessage(int64_t id, String message, String keyboard)
+#if ARDUINOJSON_VERSION_MAJOR == 6
+// the string of a JSON field, an empty string if missing
+static const char* getStringView(JsonVariant value)
 {
-	if (0 == message.length())
-		return false;
+	const char* string = value.as<const char*>();
+	return (NULL == string) ? "" : string;
+}
 
-	String strID = int64ToAscii(id);
+CTBotMessageType CTBot::parseUpdate(JsonVariant update, TBMessageView& message) {
+	JsonVariant query = update["callback_query"];
+	JsonVariant data = query["id"] ? query["message"] : update["message"];
+	JsonVariant from = query["id"] ? query["from"] : data["from"];
+
+	message.messageType       = CTBotMessageNoData;
+	message.messageID         = data["message_id"].as<int32_t>();
+	message.date              = data["date"].as<int32_t>();
+	message.text              = getStringView(data["text"]);
+	message.sender.id         = from["id"].as<int32_t>();
+	message.sender.isBot      = from["is_bot"].as<bool>();
+	message.sender.firstName  = getStringView(from["first_name"]);
+	message.sender.lastName   = getStringView(from["last_name"]);
+	message.sender.username   = getStringView(from["username"]);
+	message.sender.languageCode = getStringView(from["language_code"]);
+	message.group.id          = data["chat"]["id"].as<int64_t>();
+	message.group.title       = getStringView(data["chat"]["title"]);
+	message.callbackQueryID   = getStringView(query["id"]);
+	message.callbackQueryData = getStringView(query["data"]);
+	message.chatInstance      = getStringView(query["chat_instance"]);
+	message.location.longitude  = data["location"]["longitude"].as<float>();
+	message.location.latitude   = data["location"]["latitude"].as<float>();
+	message.contact.id          = data["contact"]["user_id"].as<int32_t>();
+	message.contact.firstName   = getStringView(data["contact"]["first_name"]);
+	message.contact.lastName    = getStringView(data["contact"]["last_name"]);
+	message.contact.phoneNumber = getStringView(data["contact"]["phone_number"]);
+	message.contact.vCard       = getStringView(data["contact"]["vcard"]);
+
+	if (query["id"])
+		message.messageType = CTBotMessageQuery;
+	else if (!data["message_id"])
+		message.messageType = CTBotMessageNoData;
+	else if (data["text"])
+		message.messageType = CTBotMessageText;
+	else if (data["location"])
+		message.messageType = CTBotMessageLocation;
+	else if (data["contact"])
+		message.messageType = CTBotMessageContact;
+	return message.messageType;
+}
+#endif
 
-	message = URLEncodeMessage(message);
+String CTBot::getMessageParameters(int64_t id, const String& keyboard) const
+{
+	String strID = int64ToAscii(id);
 
-	String parameters = (String)"?chat_id=" + strID + (String)"&text=" + message;
+	String parameters = (String)"?chat_id=" + strID;
 
 	if (keyboard.length() != 0)
 		parameters += (String)"&reply_markup=" + keyboard;
+	parameters += "&text=";
+	return parameters;
+}
+
+bool CTBot::sendMessage(int64_t id, String message, String keyboard)
+{
+	return sendMessageRequest(id, message, keyboard, NULL);
+}
+
+bool CTBot::sendMessage(int64_t id, String message, const __FlashStringHelper* keyboard)
+{
+	return sendMessageRequest(id, message, "", keyboard);
+}
+
+bool CTBot::sendMessageRequest(int64_t id, const String& message, const String& keyboard, const __FlashStringHelper* flashKeyboard)
+{
+	if (0 == message.length())
+		return false;
+
+#if defined(ARDUINO_ARCH_ESP32)
+	// the message is sent by the background task
+	if (isForeignTask())
+		return pushOutbound(id, message, (flashKeyboard != NULL) ? String(flashKeyboard) : keyboard);
+#endif
+
+#if CTBOT_USE_POST > 0
+	CTBotMessageBody body(id, message, keyboard, flashKeyboard);
+#else
+	// the keyboard is sent in the query string: a static keyboard must be URL encoded
+	String parameters = getMessageParameters(id, (flashKeyboard != NULL) ? URLEncodeMessage(String(flashKeyboard)) : keyboard);
+#endif
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
 #if CTBOT_BUFFER_SIZE > 0
@@ -291,14 +1130,23 @@ bool CTBot::sendMessage(int64_t id, String message, String keyboard)
 #endif
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DynamicJsonDocument root(CTBOT_JSON6_BUFFER_SIZE);
+	// only the outcome is stored: the received messages in m_jsonDocument are not overwritten
+	StaticJsonDocument<CTBOT_JSON6_RESULT_BUFFER_SIZE> root;
 #endif
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
-	JsonObject& root = jsonBuffer.parse(sendCommand("sendMessage", parameters));
+#if CTBOT_USE_POST > 0
+	JsonObject& root = jsonBuffer.parse(m_connection.send(getRequestLine("sendMessage", "", "POST"), body, body.length()));
+#else
+	JsonObject& root = jsonBuffer.parse(m_connection.send(getRequestLine("sendMessage", parameters), message));
+#endif
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DeserializationError error = deserializeJson(root, sendCommand("sendMessage", parameters));
+#if CTBOT_USE_POST > 0
+	DeserializationError error = deserializeCommand(root, getResultFilter(), "sendMessage", body, body.length());
+#else
+	DeserializationError error = deserializeCommand(root, getResultFilter(), "sendMessage", parameters, message);
+#endif
 	if (error) {
 		serialLog("getNewMessage error: ArduinoJson deserialization error code: ");
 		serialLog(error.c_str());
@@ -308,6 +1156,7 @@ bool CTBot::sendMessage(int64_t id, String message, String keyboard)
 #endif
 
 	if (!root["ok"]) {
+		CTBOT_STATS_ERROR(m_connection.getStats(), CTBotStatsErrorServer);
 #if CTBOT_DEBUG_MODE > 0
 		serialLog("SendMessage error: ");
 #if ARDUINOJSON_VERSION_MAJOR == 5
@@ -345,16 +1194,16 @@ bool CTBot::sendMessage(int64_t id, String message, CTBotReplyKeyboard &keyboard
 
 bool CTBot::endQuery(String queryID, String message, bool alertMode)
 {
-	if (0 == queryID.length())
+	if ((0 == queryID.length()) || isForeignTask())
 		return false;
 
 	String parameters = (String)"?callback_query_id=" + queryID;
 	if (message.length() != 0) {
-		message = URLEncodeMessage(message);
+		// the message is the last parameter: it is URL encoded straight to the connection
 		if (alertMode)
-			parameters += (String)"&text=" + message + (String)"&show_alert=true";
+			parameters += (String)"&show_alert=true&text=";
 		else
-			parameters += (String)"&text=" + message + (String)"&show_alert=false";
+			parameters += (String)"&show_alert=false&text=";
 	}
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
@@ -365,14 +1214,15 @@ bool CTBot::endQuery(String queryID, String message, bool alertMode)
 #endif
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DynamicJsonDocument root(CTBOT_JSON6_BUFFER_SIZE);
+	// only the outcome is stored: the received messages in m_jsonDocument are not overwritten
+	StaticJsonDocument<CTBOT_JSON6_RESULT_BUFFER_SIZE> root;
 #endif
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
-	JsonObject& root = jsonBuffer.parse(sendCommand("answerCallbackQuery", parameters));
+	JsonObject& root = jsonBuffer.parse(m_connection.send(getRequestLine("answerCallbackQuery", parameters), message));
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DeserializationError error = deserializeJson(root, sendCommand("answerCallbackQuery", parameters));
+	DeserializationError error = deserializeCommand(root, getResultFilter(), "answerCallbackQuery", parameters, message);
 	if (error) {
 		serialLog("getNewMessage error: ArduinoJson deserialization error code: ");
 		serialLog(error.c_str());
@@ -382,6 +1232,7 @@ bool CTBot::endQuery(String queryID, String message, bool alertMode)
 #endif
 
 	if (!root["ok"]) {
+		CTBOT_STATS_ERROR(m_connection.getStats(), CTBotStatsErrorServer);
 #if CTBOT_DEBUG_MODE > 0
 		serialLog("answerCallbackQuery error: ");
 #if ARDUINOJSON_VERSION_MAJOR == 5
@@ -415,7 +1266,7 @@ bool CTBot::removeReplyKeyboard(int64_t id, String message, bool selective)
 	JsonObject& root = jsonBuffer.createObject();
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DynamicJsonDocument root(CTBOT_JSON6_BUFFER_SIZE);
+	StaticJsonDocument<JSON_OBJECT_SIZE(2)> root;
 #endif
 
 	String command;
@@ -439,6 +1290,402 @@ bool CTBot::removeReplyKeyboard(int64_t id, String message, bool selective)
 
 
 
+// ----------------------------| ASYNCHRONOUS API
+
+bool CTBot::beginGetUpdates()
+{
+	// only one getUpdates at a time. The server refuses getUpdates while a webhook is set
+	if (m_isUpdatePending || m_webhook.isRunning() || isForeignTask())
+		return false;
+
+	CTBotAsyncRequest* request = pushAsyncRequest();
+	if (NULL == request)
+		return false;
+
+	// the request line is built when the request is started: the update offset could change in the meanwhile
+	request->type = CTBotAsyncGetUpdates;
+	m_isUpdatePending = true;
+	return true;
+}
+
+bool CTBot::sendMessageAsync(int64_t id, String message, String keyboard)
+{
+	if ((0 == message.length()) || isForeignTask())
+		return false;
+
+	CTBotAsyncRequest* request = pushAsyncRequest();
+	if (NULL == request)
+		return false;
+
+	request->type    = CTBotAsyncSendMessage;
+	request->id      = id;
+#if CTBOT_USE_POST > 0
+	request->request = getRequestLine("sendMessage", "", "POST");
+	CTBotMessageBody(id, message, keyboard).toString(request->body);
+#else
+	request->request = getRequestLine("sendMessage", getMessageParameters(id, keyboard));
+	URLEncodeMessage(message, request->request);
+#endif
+	return true;
+}
+
+bool CTBot::sendMessageAsync(int64_t id, String message, CTBotInlineKeyboard &keyboard) {
+	return sendMessageAsync(id, message, keyboard.getJSON());
+}
+
+bool CTBot::sendMessageAsync(int64_t id, String message, CTBotReplyKeyboard &keyboard) {
+	return sendMessageAsync(id, message, keyboard.getJSON());
+}
+
+void CTBot::setMessageCallback(CTBotMessageCallback callback)
+{	m_messageCallback = callback;}
+
+void CTBot::setRouter(CTBotRouter* router)
+{	m_router = router;}
+
+void CTBot::setSendMessageCallback(CTBotSendCallback callback)
+{	m_sendCallback = callback;}
+
+bool CTBot::queueMessage(int64_t id, String message, String keyboard)
+{
+	if (0 == message.length())
+		return false;
+
+#if defined(ARDUINO_ARCH_ESP32)
+	// the message is queued by the background task
+	if (isForeignTask())
+		return pushOutbound(id, message, keyboard);
+#endif
+
+	if (CTBOT_OUTBOX_SIZE == m_outboxCount) {
+		serialLog("queueMessage: outbound queue full, message dropped\n");
+		m_outboxDrops++;
+		return false;
+	}
+
+	CTBotOutboxMessage& queued = m_outbox[m_outboxCount];
+	queued.id       = id;
+	queued.message  = message;
+	queued.keyboard = keyboard;
+	queued.attempts = 0;
+	m_outboxCount++;
+	return true;
+}
+
+bool CTBot::queueMessage(int64_t id, String message, CTBotInlineKeyboard &keyboard) {
+	return queueMessage(id, message, keyboard.getJSON());
+}
+
+bool CTBot::queueMessage(int64_t id, String message, CTBotReplyKeyboard &keyboard) {
+	return queueMessage(id, message, keyboard.getJSON());
+}
+
+uint8_t CTBot::getOutboxDepth() const
+{	return m_outboxCount;}
+
+uint32_t CTBot::getOutboxDropCount() const
+{	return m_outboxDrops;}
+
+#if CTBOT_ENABLE_STATS > 0
+const CTBotStats& CTBot::getStats() const
+{	return m_connection.getStats();}
+
+void CTBot::resetStats()
+{	m_connection.getStats().reset();}
+#endif
+
+bool CTBot::isForeignTask() const
+{
+#if defined(ARDUINO_ARCH_ESP32)
+	return m_isTaskRunning && (xTaskGetCurrentTaskHandle() != m_task);
+#else
+	return false;
+#endif
+}
+
+bool CTBot::isAsyncBusy() const
+{	return m_isAsyncRunning || (m_asyncCount > 0) || (m_outboxCount > 0);}
+
+void CTBot::tick(uint32_t budget)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+	// the requests are carried on by the background task: only deliver its results
+	deliverBackground();
+	if (m_isTaskRunning)
+		return;
+#endif
+	serviceRequests(budget);
+	if (m_webhook.isRunning())
+		pollWebhook();
+
+	// deliver the received messages
+	// (without a callback they are left in the queue for getNewMessage)
+	if (m_messageCallback != NULL) {
+		TBMessage message;
+		while (popMessage(message)) {
+			if ((NULL == m_router) || !m_router->dispatch(message))
+				m_messageCallback(message);
+			// answer the webhook request of the message, with its reply (if any)
+			m_webhook.releaseRequest();
+		}
+	}
+}
+
+void CTBot::serviceRequests(uint32_t budget)
+{
+	uint32_t start = millis();
+
+	// start the next queued request, then the outbound messages
+	if (!m_isAsyncRunning && !m_connection.isBusy()) {
+		if (m_asyncCount > 0)
+			startAsyncRequest();
+		else
+			serviceOutbox();
+	}
+
+	if (m_isAsyncRunning) {
+		uint32_t elapsed = millis() - start;
+		CTBotRequestState state = m_connection.poll(elapsed < budget ? budget - elapsed : 0);
+		if ((CTBotRequestDone == state) || (CTBotRequestError == state))
+			completeAsyncRequest(CTBotRequestDone == state);
+	}
+}
+
+void CTBot::reportSendOutcome(int64_t id, bool result)
+{
+	if (NULL == m_sendCallback)
+		return;
+#if defined(ARDUINO_ARCH_ESP32)
+	// the callback is invoked by tick(), in the loop() task. The outcomes of the background task are
+	// queued even while it is stopping: m_task is cleared only once it has exited
+	if ((m_task != NULL) && (xTaskGetCurrentTaskHandle() == m_task)) {
+		CTBotSendOutcome outcome = { id, result };
+		if (!m_outcomeRing.push(outcome))
+			serialLog("Background task: outcome queue full, send outcome dropped\n");
+		return;
+	}
+#endif
+	m_sendCallback(id, result);
+}
+
+CTBot::CTBotAsyncRequest* CTBot::pushAsyncRequest()
+{
+	if (CTBOT_ASYNC_QUEUE_SIZE == m_asyncCount) {
+		serialLog("Asynchronous request queue full\n");
+		return NULL;
+	}
+	CTBotAsyncRequest* request = &m_asyncQueue[(m_asyncHead + m_asyncCount) % CTBOT_ASYNC_QUEUE_SIZE];
+	request->id = 0;
+	request->limit = 0;
+	request->request = "";
+	m_asyncCount++;
+	return request;
+}
+
+void CTBot::startAsyncRequest()
+{
+	CTBotAsyncRequest& request = m_asyncQueue[m_asyncHead];
+	m_asyncHead = (m_asyncHead + 1) % CTBOT_ASYNC_QUEUE_SIZE;
+	m_asyncCount--;
+
+	uint32_t timeout = CTBOT_RESPONSE_TIMEOUT;
+	if (CTBotAsyncGetUpdates == request.type) {
+		request.limit = getUpdatesLimit();
+		if (0 == request.limit) {
+			// the message queue is full: nothing to fetch
+			serialLog("beginGetUpdates: message queue full\n");
+			m_isUpdatePending = false;
+			return;
+		}
+		request.request = getRequestLine("getUpdates", getUpdatesParameters(request.limit));
+		// the server holds the request up to m_pollingTimeout seconds: wait for it
+		timeout += (uint32_t)m_pollingTimeout * 1000;
+	}
+
+	m_asyncCurrent.type  = request.type;
+	m_asyncCurrent.id    = request.id;
+	m_asyncCurrent.limit = request.limit;
+	m_isAsyncRunning = m_connection.beginRequest(request.request, timeout, request.body);
+	request.request = "";
+	request.body    = "";
+	if (!m_isAsyncRunning)
+		completeAsyncRequest(false);
+}
+
+void CTBot::completeAsyncRequest(bool isDone)
+{
+	m_isAsyncRunning = false;
+	String response = m_connection.takeResponse();
+	bool result = false;
+	uint32_t retryAfter = 0;
+
+	if (isDone) {
+		if (m_UTF8Encoding)
+			toUTF8(response);
+#if ARDUINOJSON_VERSION_MAJOR == 5
+#if CTBOT_BUFFER_SIZE > 0
+		StaticJsonBuffer<CTBOT_JSON5_BUFFER_SIZE> jsonBuffer;
+#else
+		DynamicJsonBuffer jsonBuffer;
+#endif
+		JsonObject& root = jsonBuffer.parse(response);
+		if (CTBotAsyncGetUpdates == m_asyncCurrent.type)
+			result = storeUpdates(root, m_asyncCurrent.limit);
+		else {
+			result = root["ok"];
+			retryAfter = root["parameters"]["retry_after"].as<uint32_t>();
+			if (!result)
+				CTBOT_STATS_ERROR(m_connection.getStats(), CTBotStatsErrorServer);
+		}
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+		// only the updates are stored in m_jsonDocument: the outcome of the other commands
+		// doesn't overwrite the received messages
+		StaticJsonDocument<CTBOT_JSON6_RESULT_BUFFER_SIZE> resultDocument;
+		JsonDocument& root = (CTBotAsyncGetUpdates == m_asyncCurrent.type) ? (JsonDocument&)m_jsonDocument : resultDocument;
+		const JsonDocument& filter = (CTBotAsyncGetUpdates == m_asyncCurrent.type) ? getUpdatesFilter() : getResultFilter();
+		if (CTBotAsyncGetUpdates == m_asyncCurrent.type)
+			m_viewCount = 0; // the document is reused
+		DeserializationError error = parseResponse(root, response, filter);
+		if (error) {
+			if (CTBotAsyncGetUpdates == m_asyncCurrent.type)
+				handleUpdatesError(error, m_asyncCurrent.limit, response);
+			else {
+				serialLog("tick error: ArduinoJson deserialization error code: ");
+				serialLog(error.c_str());
+				serialLog("\n");
+			}
+		}
+		else if (CTBotAsyncGetUpdates == m_asyncCurrent.type)
+			result = storeUpdates(root, m_asyncCurrent.limit);
+		else {
+			result = root["ok"].as<bool>();
+			retryAfter = root["parameters"]["retry_after"].as<uint32_t>();
+			if (!result)
+				CTBOT_STATS_ERROR(m_connection.getStats(), CTBotStatsErrorServer);
+		}
+#endif
+	}
+
+	if (CTBotAsyncGetUpdates == m_asyncCurrent.type)
+		m_isUpdatePending = false;
+	else if (CTBotAsyncOutbox == m_asyncCurrent.type)
+		completeOutboxMessage(result, retryAfter);
+	else
+		reportSendOutcome(m_asyncCurrent.id, result);
+}
+
+bool CTBot::serviceOutbox()
+{
+	if (0 == m_outboxCount)
+		return false;
+
+	// refill the global token bucket: CTBOT_OUTBOX_GLOBAL_RATE messages per second, one second of burst.
+	// The bucket is full after one second: a longer idle time would only overflow the multiplication
+	uint32_t now = millis();
+	uint32_t elapsed = now - m_lastRefill;
+	if (elapsed > 1000)
+		elapsed = 1000;
+	m_globalTokens += elapsed * CTBOT_OUTBOX_GLOBAL_RATE;
+	if (m_globalTokens > CTBOT_OUTBOX_GLOBAL_RATE * 1000)
+		m_globalTokens = CTBOT_OUTBOX_GLOBAL_RATE * 1000;
+	m_lastRefill = now;
+	if (m_globalTokens < 1000)
+		return false;
+
+	// the first message whose chat is not rate limited (the messages to the same chat keep their order)
+	for (uint8_t i = 0; i < m_outboxCount; i++) {
+		CTBotOutboxMessage& message = m_outbox[i];
+		CTBotChatRate* rate = getChatRate(message.id, false);
+		if ((rate != NULL) && ((int32_t)(rate->nextSend - now) > 0))
+			continue;
+
+#if CTBOT_USE_POST > 0
+		String body;
+		CTBotMessageBody(message.id, message.message, message.keyboard).toString(body);
+		if (!m_connection.beginRequest(getRequestLine("sendMessage", "", "POST"), CTBOT_RESPONSE_TIMEOUT, body))
+			return false;
+#else
+		String request = getRequestLine("sendMessage", getMessageParameters(message.id, message.keyboard));
+		URLEncodeMessage(message.message, request);
+		if (!m_connection.beginRequest(request, CTBOT_RESPONSE_TIMEOUT))
+			return false;
+#endif
+
+		m_globalTokens -= 1000;
+		rate = getChatRate(message.id, true);
+		rate->nextSend = now + ((message.id < 0) ? CTBOT_OUTBOX_GROUP_INTERVAL : CTBOT_OUTBOX_CHAT_INTERVAL);
+
+		m_asyncCurrent.type = CTBotAsyncOutbox;
+		m_asyncCurrent.id   = message.id;
+		m_asyncCurrent.slot = i;
+		m_isAsyncRunning    = true;
+		return true;
+	}
+	return false;
+}
+
+void CTBot::completeOutboxMessage(bool result, uint32_t retryAfter)
+{
+	CTBotOutboxMessage& message = m_outbox[m_asyncCurrent.slot];
+	bool isCompleted = result;
+
+	if (!result) {
+		uint32_t backoff;
+		if (retryAfter > 0) {
+			// 429 Too Many Requests: wait as asked by the server
+			backoff = retryAfter * 1000;
+		}
+		else {
+			message.attempts++;
+			isCompleted = (message.attempts > CTBOT_OUTBOX_MAX_RETRIES);
+			backoff = (uint32_t)CTBOT_OUTBOX_BACKOFF << (message.attempts - 1);
+		}
+		if (isCompleted) {
+			serialLog("queueMessage: too many failures, message dropped\n");
+			m_outboxDrops++;
+		}
+		else
+			getChatRate(message.id, true)->nextSend = millis() + backoff;
+	}
+
+	if (!isCompleted)
+		return;
+
+	reportSendOutcome(message.id, result);
+
+	// remove the message from the queue
+	for (uint8_t i = m_asyncCurrent.slot; i + 1 < m_outboxCount; i++)
+		m_outbox[i] = std::move(m_outbox[i + 1]);
+	m_outboxCount--;
+	m_outbox[m_outboxCount].message  = "";
+	m_outbox[m_outboxCount].keyboard = "";
+}
+
+CTBot::CTBotChatRate* CTBot::getChatRate(int64_t id, bool create)
+{
+	CTBotChatRate* oldest = &m_chatRates[0];
+	uint32_t now = millis();
+
+	for (uint8_t i = 0; i < CTBOT_OUTBOX_CHATS; i++) {
+		if (m_chatRates[i].id == id)
+			return &m_chatRates[i];
+		// the entry whose rate limit expired first
+		if ((int32_t)((m_chatRates[i].nextSend - now) - (oldest->nextSend - now)) < 0)
+			oldest = &m_chatRates[i];
+	}
+	if (!create)
+		return NULL;
+
+	oldest->id       = id;
+	oldest->nextSend = now;
+	return oldest;
+}
+
+
+
+
+
 // ----------------------------| STUBS - FOR BACKWARD VERSION COMPATIBILITY
 
 bool CTBot::useDNS(bool value)
@@ -471,3 +1718,114 @@ bool CTBot::wifiConnect(String ssid, String password) const
 	return(m_wifi.wifiConnect(ssid, password));
 }
 
+
+
+// ----------------------------| BACKGROUND TASK
+
+#if defined(ARDUINO_ARCH_ESP32)
+bool CTBot::startBackgroundTask(uint8_t core)
+{
+	// the webhook server replaces the polling of the background task
+	if (m_isTaskRunning || m_isTaskAlive || m_webhook.isRunning())
+		return false;
+
+	m_isTaskRunning = true;
+	m_isTaskAlive   = true;
+	if (xTaskCreatePinnedToCore(backgroundTask, "CTBot", CTBOT_BACKGROUND_STACK_SIZE, this,
+		CTBOT_BACKGROUND_PRIORITY, &m_task, core) != pdPASS) {
+		serialLog("Unable to create the background task\n");
+		m_isTaskRunning = false;
+		m_isTaskAlive   = false;
+		m_task = NULL;
+		return false;
+	}
+	return true;
+}
+
+void CTBot::stopBackgroundTask()
+{
+	if (!m_isTaskRunning)
+		return;
+
+	// the task completes the current step and exits. m_task is kept until then, so the send
+	// outcomes of that step are still queued for tick()
+	m_isTaskRunning = false;
+	while (m_isTaskAlive)
+		delay(1);
+	m_task = NULL;
+
+	// now this task owns the connection: the messages not yet taken by the background task are queued
+	CTBotOutboxMessage message;
+	while (m_outboundRing.pop(message)) {
+		if (!queueMessage(message.id, message.message, message.keyboard))
+			reportSendOutcome(message.id, false);
+	}
+}
+
+bool CTBot::isBackgroundRunning() const
+{	return m_isTaskRunning;}
+
+void CTBot::backgroundTask(void* bot)
+{
+	((CTBot*)bot)->runBackgroundTask();
+	vTaskDelete(NULL);
+}
+
+void CTBot::runBackgroundTask()
+{
+	while (m_isTaskRunning) {
+		// the messages sent by loop(): the outbound queue sends them honouring the rate limits
+		CTBotOutboxMessage message;
+		while ((m_outboxCount < CTBOT_OUTBOX_SIZE) && m_outboundRing.pop(message))
+			queueMessage(message.id, message.message, message.keyboard);
+
+		// poll the updates only when the received messages have been handed over
+		if (!m_isUpdatePending && (0 == m_queueCount))
+			beginGetUpdates();
+
+		serviceRequests(CTBOT_ASYNC_TICK_BUDGET);
+
+		// hand the received messages over to loop(). Once stopped, the consumer of the inbound queue
+		// is loop() and the messages left in the updates queue are read by getNewMessage()
+		TBMessage received;
+		while (m_isTaskRunning && !m_inboundRing.isFull() && popReceivedMessage(received))
+			m_inboundRing.push(received);
+
+		// let the lower priority tasks (i.e. the idle task and its watchdog) run
+		vTaskDelay(1);
+	}
+	m_isTaskAlive = false;
+}
+
+bool CTBot::pushOutbound(int64_t id, const String& message, const String& keyboard)
+{
+	CTBotOutboxMessage outbound;
+	outbound.id       = id;
+	outbound.message  = message;
+	outbound.keyboard = keyboard;
+	outbound.attempts = 0;
+	if (m_outboundRing.push(outbound))
+		return true;
+
+	serialLog("Background task: outbound queue full, message dropped\n");
+	return false;
+}
+
+void CTBot::deliverBackground()
+{
+	CTBotSendOutcome outcome;
+	while (m_outcomeRing.pop(outcome)) {
+		if (m_sendCallback != NULL)
+			m_sendCallback(outcome.id, outcome.result);
+	}
+
+	// once stopped, the messages left by the task are delivered by popMessage()
+	if (!m_isTaskRunning || (NULL == m_messageCallback))
+		return;
+	TBMessage message;
+	while (m_inboundRing.pop(message)) {
+		if ((NULL == m_router) || !m_router->dispatch(message))
+			m_messageCallback(message);
+	}
+}
+#endif
@@ -7,8 +7,15 @@
 #include "CTBotDataStructures.h"
 #include "CTBotInlineKeyboard.h"
 #include "CTBotReplyKeyboard.h"
+#include "CTBotStaticKeyboard.h"
+#include "CTBotRouter.h"
 #include "CTBotDefines.h"
 #include "CTBotWifiSetup.h"
+#include "CTBotWebhookServer.h"
+#if defined(ARDUINO_ARCH_ESP32)
+#include <atomic>
+#include "CTBotRingBuffer.h"
+#endif
 
 class CTBot
 {
@@ -30,14 +37,81 @@ public:
 	//          false -> leave the received message as-is
 	void enableUTF8Encoding(bool value);
 
+	// keep the connection with the Telegram server open between requests (HTTP/1.1 keep-alive)
+	// instead of doing a new TLS handshake for every request.
+	// Default value is false (a new connection for every request)
+	// params
+	//   value: true  -> reuse the same connection, reconnect only when the link drops
+	//          false -> open a new connection for every request
+	void useKeepAlive(bool value);
+
+	// get how many TLS handshakes were made with the Telegram server
+	// returns
+	//   the number of handshakes
+	uint32_t getHandshakeCount(void) const;
+
+	// get how many times a kept alive connection has been dropped and re-established
+	// returns
+	//   the number of reconnections
+	uint32_t getReconnectCount(void) const;
+
+	// get how many TLS handshakes resumed the session of the previous connection (abbreviated
+	// handshake). Only for ESP8266, see CTBotSecureConnection::getResumedHandshakeCount()
+	// returns
+	//   the number of resumed handshakes
+	uint32_t getResumedHandshakeCount(void) const;
+
+	// get the state of the circuit breaker: after CTBOT_CIRCUIT_THRESHOLD consecutive failed requests
+	// the requests fail fast (no connection attempt) until a probe request succeeds.
+	// See CTBotSecureConnection::getCircuitState()
+	// returns
+	//   CTBotCircuitClosed, CTBotCircuitOpen or CTBotCircuitHalfOpen
+	CTBotCircuitState getCircuitState(void) const;
+
+	// get how long the requests still fail fast
+	// returns
+	//   the milliseconds before the next probe request, zero if the requests are sent
+	uint32_t getCircuitRetryDelay(void) const;
+
+	// recover the connectivity: if the WiFi dropped a reconnection is requested (it never waits),
+	// if the WiFi is connected the circuit breaker is closed so the next request is sent immediately
+	// returns
+	//   true if the WiFi is connected
+	bool reconnect(void);
+
+	// add an address of the Telegram server to the ones tried by every connection (the fixed IP and,
+	// in use DNS mode, the resolved one). See CTBotSecureConnection::addEndpoint()
+	// params
+	//   ip: the IP address, i.e. "149.154.167.220"
+	// returns
+	//   false if the address is not valid
+	bool addEndpoint(const String& ip);
+
+	// replace the built-in TLS client with a custom transport (i.e. a client connected to a
+	// local fake Telegram server, for testing or benchmarking). See CTBotSecureConnection::setTransport()
+	// params
+	//   client: the transport to use, NULL -> restore the built-in TLS client
+	void setTransport(Client* client);
+
 	// test the connection between ESP8266 and the telegram server
 	// returns
 	//    true if no error occurred
 	bool testConnection(void);
 
+	// set the long polling timeout used by getNewMessage. With a non zero value, the Telegram server
+	// keeps the request open until a new message arrives or the timeout expires, so getNewMessage
+	// returns as soon as a message is received and no request is wasted while nobody is talking.
+	// Note that getNewMessage blocks up to <timeout> seconds waiting for a message.
+	// Default value is zero (short polling)
+	// params
+	//   timeout: the long polling timeout, in seconds
+	void setPollingTimeout(uint16_t timeout);
+
 	// get the first unread message from the queue (text and query from inline keyboard). 
 	// This is a destructive operation: once read, the message will be marked as read
 	// so a new getMessage will read the next message (if any).
+	// Up to CTBOT_UPDATES_BATCH_SIZE messages are fetched with a single request and queued:
+	// the following calls return the queued messages without any network activity.
 	// params
 	//   message: the data structure that will contains the data retrieved
 	// returns
@@ -46,6 +120,23 @@ public:
 	//   CTBotMessageQuery : the received message is a query (from inline keyboards)
 	CTBotMessageType getNewMessage(TBMessage &message);
 
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	// get the first unread message, without copying its data: the message references the parsed
+	// Telegram response (no heap allocation). The strings of the message are valid until the next
+	// getNewMessage() call (or testConnection()/tick() call): copy them if they are needed later.
+	// A batch of up to CTBOT_UPDATES_BATCH_SIZE updates is fetched with a single request, then
+	// the following calls read it without any network activity.
+	// The messages queued by the TBMessage version (or by beginGetUpdates() or a stopped background
+	// task) can't be referenced: no message is returned until they are read with getNewMessage(TBMessage&)
+	// params
+	//   message: the data structure that will reference the data retrieved
+	// returns
+	//   CTBotMessageNoData: an error has occurred or no new message
+	//   CTBotMessageText  : the received message is a text
+	//   CTBotMessageQuery : the received message is a query (from inline keyboards)
+	CTBotMessageType getNewMessage(TBMessageView &message);
+#endif
+
 	// send a message to the specified telegram user ID
 	// params
 	//   id      : the telegram recipient user ID 
@@ -58,6 +149,16 @@ public:
 	bool sendMessage(int64_t id, String message, CTBotInlineKeyboard &keyboard);
 	bool sendMessage(int64_t id, String message, CTBotReplyKeyboard  &keyboard);
 
+	// send a message with a static keyboard stored in flash (see CTBotStaticKeyboard.h):
+	// the keyboard is sent straight from the flash, without any copy or serialization
+	// params
+	//   id      : the telegram recipient user ID 
+	//   message : the message to send
+	//   keyboard: the keyboard, i.e. FPSTR(myKeyboard)
+	// returns
+	//   true if no error occurred
+	bool sendMessage(int64_t id, String message, const __FlashStringHelper* keyboard);
+
 	// terminate a query started by pressing an inlineKeyboard button. The steps are:
 	// 1) send a message with an inline keyboard
 	// 2) wait for a <message> (getNewMessage) of type CTBotMessageQuery
@@ -89,20 +190,545 @@ public:
 	//   a string containing the Telegram JSON response
 	String sendCommand(String command, String parameters = "");
 
+	// ----------------------------| ASYNCHRONOUS API
+	// The asynchronous member functions only enqueue the request and return immediately.
+	// The requests are carried on by tick(), that must be called in the loop() function: 
+	// every call spends at most <budget> milliseconds (but the connection to the server, 
+	// that is blocking: use the keep alive mode to do it only when the link drops).
+	// The completions are reported by the callbacks; the received messages can also be read
+	// with getNewMessage(). While an asynchronous request is in progress, all the blocking
+	// member functions (getNewMessage, sendMessage...) fail immediately.
+
+	// enqueue a getUpdates request: the received messages are queued and delivered by the
+	// message callback (if set) or by getNewMessage()
+	// returns
+	//   false if a getUpdates request is already pending, the request queue is full
+	//   or the webhook server is running
+	bool beginGetUpdates(void);
+
+	// enqueue a message to send to the specified telegram user ID. The result is 
+	// reported by the send callback (if set)
+	// params
+	//   id      : the telegram recipient user ID 
+	//   message : the message to send
+	//   keyboard: the inline/reply keyboard (optional)
+	// returns
+	//   false if the request queue is full
+	bool sendMessageAsync(int64_t id, String message, String keyboard = "");
+	bool sendMessageAsync(int64_t id, String message, CTBotInlineKeyboard &keyboard);
+	bool sendMessageAsync(int64_t id, String message, CTBotReplyKeyboard  &keyboard);
+
+	// advance the asynchronous requests and invoke the callbacks
+	// params
+	//   budget: the max time to spend, in milliseconds
+	void tick(uint32_t budget = CTBOT_ASYNC_TICK_BUDGET);
+
+	// set the callback invoked by tick() for every received message
+	// params
+	//   callback: the callback, NULL to disable it
+	void setMessageCallback(CTBotMessageCallback callback);
+
+	// attach a command router: getNewMessage() (and tick(), when a message callback is set) dispatch
+	// every received /command and callback query to its handler (see CTBotRouter). The handled
+	// messages are consumed: only the unrouted ones are returned by getNewMessage() or passed
+	// to the message callback
+	// params
+	//   router: the router, NULL to detach it
+	void setRouter(CTBotRouter* router);
+
+	// set the callback invoked by tick() when an asynchronous sendMessage is completed
+	// params
+	//   callback: the callback, NULL to disable it
+	void setSendMessageCallback(CTBotSendCallback callback);
+
+	// enqueue a message in the outbound queue. The queued messages are sent by tick() honouring
+	// the Telegram rate limits (about 30 messages per second overall, 1 message per second
+	// to the same chat). When the server answers 429 (Too Many Requests) the message is sent again
+	// after the retry_after time; on other failures it is retried with an exponential backoff and 
+	// dropped after CTBOT_OUTBOX_MAX_RETRIES attempts. The final outcome of every message is reported
+	// by the send callback (if set)
+	// params
+	//   id      : the telegram recipient user ID 
+	//   message : the message to send
+	//   keyboard: the inline/reply keyboard (optional)
+	// returns
+	//   false if the outbound queue is full (the message is dropped)
+	bool queueMessage(int64_t id, String message, String keyboard = "");
+	bool queueMessage(int64_t id, String message, CTBotInlineKeyboard &keyboard);
+	bool queueMessage(int64_t id, String message, CTBotReplyKeyboard  &keyboard);
+
+	// get how many messages are waiting in the outbound queue
+	// returns
+	//   the number of queued messages
+	uint8_t getOutboxDepth(void) const;
+
+	// get how many messages were dropped (outbound queue full or too many failures)
+	// returns
+	//   the number of dropped messages
+	uint32_t getOutboxDropCount(void) const;
+
+	// ----------------------------| WEBHOOK
+	// Instead of polling with getUpdates, the Telegram server POSTs every update to a webhook URL:
+	// the bot sends no request at all while idle, and a message is received as soon as it is sent.
+	// The webhook server is a plain HTTP server (see CTBotWebhookServer): Telegram accepts only HTTPS
+	// webhooks (ports 443, 80, 88 or 8443), so a reverse proxy must terminate the TLS and forward
+	// the requests to the board. While the webhook server is running, getNewMessage() and tick()
+	// receive the updates from it instead of polling the Telegram server.
+
+	// register the webhook URL with the Telegram server (getUpdates is refused until deleteWebhook).
+	// The updates are sent one at a time (max_connections=1), only messages and callback queries
+	// params
+	//   url        : the HTTPS URL that forwards to the webhook server, i.e. https://example.com/bot
+	//   secretToken: (optional) the secret token sent by Telegram with every update. The webhook
+	//                server refuses the requests without it. Allowed characters: A-Z, a-z, 0-9, _ and -
+	// returns
+	//   true if no error occurred
+	bool setWebhook(const String& url, const String& secretToken = "");
+
+	// remove the webhook: the updates can be fetched again with getUpdates
+	// returns
+	//   true if no error occurred
+	bool deleteWebhook(void);
+
+	// start the embedded webhook server
+	// params
+	//   port: the TCP port where the reverse proxy forwards the webhook requests
+	// returns
+	//   false if the background task is running (only for ESP32)
+	bool startWebhookServer(uint16_t port = CTBOT_WEBHOOK_PORT);
+
+	// stop the webhook server: getNewMessage() polls the Telegram server again
+	void stopWebhookServer(void);
+
+	// handle a webhook request: read the POSTed update, store the message in the queue (read by
+	// getNewMessage() or delivered by tick()) and answer. Called by getNewMessage() and tick() for
+	// every connection accepted by the webhook server; it can also be fed with any other Client,
+	// i.e. a connection accepted by an existing web server or a fake client for testing.
+	// The request is answered at once: its message can't get a deferred reply (see replyMessage())
+	// params
+	//   client: the connection with the webhook request
+	// returns
+	//   true if the update has been accepted
+	bool handleWebhookRequest(Client& client);
+
+	// reply to the message received with the webhook, inside the answer to the webhook request
+	// (deferred reply): the Telegram server executes the sendMessage when it gets the answer, so no
+	// request is sent to the server. The request of a message received by the webhook server is held
+	// open until the message is handled: the answer is sent by the next getNewMessage() call, after
+	// the router handler or after the message callback of tick(). Only the first reply to a message
+	// can be deferred: the other ones (and the replies without a pending webhook request, i.e. in
+	// polling mode) are sent with sendMessage()
+	// params
+	//   id      : the telegram recipient user ID
+	//   message : the message to send
+	//   keyboard: the inline/reply keyboard (optional)
+	// returns
+	//   true if the reply has been deferred (its outcome is not reported by the server)
+	//   or sent without errors
+	bool replyMessage(int64_t id, String message, String keyboard = "");
+	bool replyMessage(int64_t id, String message, CTBotInlineKeyboard &keyboard);
+	bool replyMessage(int64_t id, String message, CTBotReplyKeyboard  &keyboard);
+
+	// terminate a query inside the answer to the webhook request, as replyMessage() does.
+	// Falls back to endQuery() if the reply can't be deferred
+	// params
+	//   queryID  : the unique query ID (retrieved with getNewMessage method)
+	//   message  : an optional message
+	//   alertMode: false -> a simply popup message
+	//              true --> an alert message with ok button
+	// returns
+	//   true if the reply has been deferred or sent without errors
+	bool replyQuery(String queryID, String message = "", bool alertMode = false);
+
+#if CTBOT_ENABLE_STATS > 0
+	// get the statistics of the requests sent to the Telegram server: per phase timings
+	// (min/average/max and histogram), byte counts, heap low-water mark and errors by cause.
+	// Only if CTBOT_ENABLE_STATS is enabled (see CTBotDefines.h)
+	// returns
+	//   the statistics
+	const CTBotStats& getStats(void) const;
+
+	// clear the statistics
+	void resetStats(void);
+#endif
+
+	// check if there are asynchronous requests pending or in progress
+	// returns
+	//   true if there are asynchronous requests to complete
+	bool isAsyncBusy(void) const;
+
+#if defined(ARDUINO_ARCH_ESP32)
+	// ----------------------------| BACKGROUND TASK (only for ESP32)
+	// Run the connection with the Telegram server in a FreeRTOS task pinned to a core (by default
+	// the core 0, the Arduino loop() runs on the core 1): the TLS round trips never stall loop().
+	// The task polls the updates and sends the outbound messages; the received messages and the
+	// outcomes of the sends are handed over through lock-free queues (see CTBotRingBuffer), so
+	// getNewMessage() returns immediately. While the task is running:
+	// - getNewMessage(TBMessage&) reads the messages received by the task
+	// - sendMessage() and queueMessage() hand the message to the task and return immediately:
+	//   the result only tells if it has been enqueued; the outcome is reported by the send callback
+	// - tick() invokes the message/send callbacks (in the loop() task)
+	// - the other member functions that talk with the server fail immediately. Configure the bot
+	//   (token, keep alive, polling timeout...) before starting the task
+	// The updates and the sends share the connection: with long polling, a send waits for the
+	// end of the current getUpdates. Keep the polling timeout short (a few seconds)
+	// params
+	//   core: the core where the task runs
+	// returns
+	//   false if the task is already running, can't be created or the webhook server is running
+	bool startBackgroundTask(uint8_t core = 0);
+
+	// stop the background task: it completes the current step and exits. The messages still in
+	// the queues are delivered/sent by getNewMessage() and tick(), as without the background task
+	void stopBackgroundTask(void);
+
+	// check if the background task is running
+	// returns
+	//   true if the background task is running
+	bool isBackgroundRunning(void) const;
+#endif
+
 private:
+	enum CTBotAsyncRequestType {
+		CTBotAsyncGetUpdates  = 0,
+		CTBotAsyncSendMessage = 1,
+		CTBotAsyncOutbox      = 2
+	};
+
+	struct CTBotAsyncRequest {
+		uint8_t type;
+		uint8_t limit;   // getUpdates: how many updates were requested
+		uint8_t slot;    // outbox: the position of the message in the outbound queue
+		int64_t id;      // sendMessage: the recipient
+		String  request; // the request line (built when started for getUpdates)
+		String  body;    // the JSON body (POST requests)
+	};
+
 	CTBotSecureConnection m_connection;
 	String                m_token{};
 	int32_t               m_lastUpdate;
+	uint16_t              m_pollingTimeout;
+	uint8_t               m_updatesLimit;  // how many updates to fetch with a single getUpdates
+	TBMessage             m_updatesQueue[CTBOT_UPDATES_QUEUE_SIZE]; // received messages, waiting to be read
+	uint8_t               m_queueHead;
+	uint8_t               m_queueCount;
+	struct CTBotOutboxMessage {
+		int64_t id;
+		String  message;
+		String  keyboard;
+		uint8_t attempts; // how many times the message failed
+	};
+
+	struct CTBotChatRate {
+		int64_t  id;
+		uint32_t nextSend; // when the next message to this chat can be sent (millis)
+	};
+
+	CTBotAsyncRequest     m_asyncQueue[CTBOT_ASYNC_QUEUE_SIZE]; // asynchronous requests waiting to be sent
+	uint8_t               m_asyncHead;
+	uint8_t               m_asyncCount;
+	CTBotAsyncRequest     m_asyncCurrent;     // the asynchronous request in progress
+	bool                  m_isAsyncRunning;
+	bool                  m_isUpdatePending;  // a getUpdates request is pending or in progress
+	CTBotMessageCallback  m_messageCallback;
+	CTBotSendCallback     m_sendCallback;
+	CTBotRouter*          m_router;
+	CTBotOutboxMessage    m_outbox[CTBOT_OUTBOX_SIZE]; // outbound queue
+	uint8_t               m_outboxCount;
+	uint32_t              m_outboxDrops;
+	CTBotChatRate         m_chatRates[CTBOT_OUTBOX_CHATS]; // per chat rate limit
+	uint32_t              m_globalTokens;  // global rate limit token bucket, in thousandths of message
+	uint32_t              m_lastRefill;    // last token bucket refill (millis)
 	bool                  m_UTF8Encoding;
 	bool                  m_needInsecureFlag;
 	CTBotWifiSetup        m_wifi;
+	CTBotWebhookServer    m_webhook;
+#if defined(ARDUINO_ARCH_ESP32)
+	struct CTBotSendOutcome {
+		int64_t id;
+		bool    result;
+	};
+
+	CTBotRingBuffer<TBMessage, CTBOT_BACKGROUND_QUEUE_SIZE>          m_inboundRing;  // received messages: background task -> loop()
+	CTBotRingBuffer<CTBotOutboxMessage, CTBOT_BACKGROUND_QUEUE_SIZE> m_outboundRing; // messages to send: loop() -> background task
+	CTBotRingBuffer<CTBotSendOutcome, CTBOT_BACKGROUND_QUEUE_SIZE>   m_outcomeRing;  // outcomes of the sends: background task -> loop()
+	TaskHandle_t          m_task{ NULL };
+	std::atomic<bool>     m_isTaskRunning{ false }; // cleared to ask the task to stop
+	std::atomic<bool>     m_isTaskAlive{ false };   // cleared by the task when it exits
+
+	// entry point of the background task
+	// params
+	//   bot: the CTBot instance
+	static void backgroundTask(void* bot);
+
+	// the background task loop
+	void runBackgroundTask(void);
+
+	// enqueue a message for the background task
+	// returns
+	//   false if the queue is full
+	bool pushOutbound(int64_t id, const String& message, const String& keyboard);
+
+	// deliver the messages and the send outcomes of the background task (called by tick())
+	void deliverBackground(void);
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	// the JSON document shared by all the commands: it is allocated once and reused,
+	// so the heap is not fragmented by a new document for every request
+#if CTBOT_JSON6_STATIC_BUFFER > 0
+	StaticJsonDocument<CTBOT_JSON6_BUFFER_SIZE> m_jsonDocument;
+#else
+	DynamicJsonDocument   m_jsonDocument{ CTBOT_JSON6_BUFFER_SIZE };
+#endif
+	uint8_t               m_viewNext{ 0 };  // the next update of the document read by getNewMessage(TBMessageView&)
+	uint8_t               m_viewCount{ 0 }; // how many updates are in the document. Zero -> the document has been reused
+#endif
+
+	// convert the \uXXXX escape sequences of a JSON response to UTF8, in place. The escape
+	// sequences of quotes, backslashes and control characters are left untouched (the JSON stays valid)
+	// params
+	//   message: the JSON response to convert
+	void toUTF8(String& message) const;
+
+	// build the request line of a command
+	// params
+	//   command   : the command to send, i.e. getMe
+	//   parameters: optional parameters
+	//   method    : (optional) the HTTP method
+	// returns
+	//   the request line, i.e. GET /bot<token>/getMe
+	String getRequestLine(const String& command, const String& parameters, const char* method = "GET") const;
+
+	// fetch a batch of updates from the Telegram server and store the handled messages in the queue.
+	// The update offset is advanced once for the whole batch
+	// returns
+	//   true if no error occurred
+	bool fetchUpdates(void);
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	// send a getUpdates request and parse the response into m_jsonDocument. A batch that doesn't fit
+	// the document is asked with fewer updates next time (see handleUpdatesError())
+	// params
+	//   limit: how many updates to fetch
+	// returns
+	//   true if the response has been parsed (it can still be an error answer, see checkUpdates())
+	bool requestUpdates(uint8_t limit);
+
+	// handle a getUpdates response that can't be parsed: a batch that doesn't fit the JSON document
+	// halves the batch size, a single update that doesn't fit is skipped (see skipUpdate())
+	// params
+	//   error   : the ArduinoJson deserialization error
+	//   limit   : how many updates were requested
+	//   response: the response, if stored in a String (asynchronous request)
+	void handleUpdatesError(DeserializationError error, uint8_t limit, const String& response = "");
+#endif
+
+	// check the outcome of a getUpdates response (and print it in debug mode)
+	// params
+	//   root: the JSON of the getUpdates response
+	// returns
+	//   true if the server answered "ok"
+	template <typename T>
+	bool checkUpdates(T& root);
+
+	// check if there are received messages not read yet: the queued updates and the messages
+	// left by a stopped background task
+	// returns
+	//   true if getNewMessage(TBMessage&) has messages to return
+	bool hasQueuedMessages(void) const;
+
+	// get how many updates can be fetched with the next getUpdates
+	// returns
+	//   the number of updates, zero if the message queue is full
+	uint8_t getUpdatesLimit(void) const;
+
+	// build the getUpdates parameters (limit, offset and long polling timeout)
+	// params
+	//   limit: how many updates to fetch
+	// returns
+	//   the getUpdates parameters
+	String getUpdatesParameters(uint8_t limit) const;
+
+	// store the updates of a getUpdates response in the message queue
+	// params
+	//   root : the JSON of the getUpdates response
+	//   limit: how many updates were requested
+	// returns
+	//   true if no error occurred
+	template <typename T>
+	bool storeUpdates(T& root, uint8_t limit);
+
+	// advance the update offset past a received update
+	// params
+	//   update: the JSON of the update
+	// returns
+	//   false if the update has already been received (i.e. sent again after a lost webhook answer)
+	bool isNewUpdate(JsonVariant update);
+
+	// store a received update in the message queue. The update offset is advanced: an update
+	// sent again by the server (i.e. a lost webhook answer) is skipped
+	// params
+	//   update: the JSON of the update
+	void storeUpdate(JsonVariant update);
+
+	// read a webhook request and store its update in the message queue. The request is not answered
+	// params
+	//   client: the connection with the webhook request
+	//   view  : (ArduinoJson 6) if not NULL, the update is read into the view instead of the queue
+	// returns
+	//   the HTTP status code to answer
+	uint16_t storeWebhookUpdate(Client& client, TBMessageView* view = NULL);
+
+	// handle the first pending webhook request, if any. The request of the message read next is
+	// held open until the message is handled
+	// params
+	//   view: if not NULL, the update is read into the view instead of the queue
+	void pollWebhook(TBMessageView* view = NULL);
 
-	// convert an UNICODE string to UTF8 encoded string
+	// send a command that returns only its outcome (i.e. setWebhook)
 	// params
-	//   message: the UNICODE message
+	//   command   : the command to send
+	//   parameters: the parameters
 	// returns
-	//   a string with the converted message in UTF8 
-	String toUTF8(String message) const;
+	//   true if no error occurred
+	bool executeCommand(const String& command, const String& parameters);
+
+	// check if the connection is owned by the background task (see startBackgroundTask()) and the
+	// caller is another task: the requests to the server are not allowed
+	// returns
+	//   true if the caller can't talk with the server
+	bool isForeignTask(void) const;
+
+	// report the outcome of a send to the send callback. Within the background task, the outcome
+	// is handed over to loop() (the callback is invoked by tick())
+	// params
+	//   id    : the telegram recipient user ID
+	//   result: true if no error occurred
+	void reportSendOutcome(int64_t id, bool result);
+
+	// carry on the asynchronous requests and the outbound queue (see tick())
+	// params
+	//   budget: the max time to spend, in milliseconds
+	void serviceRequests(uint32_t budget);
+
+	// get the first message of the queue: the messages left by a stopped background task come first
+	// params
+	//   message: the data structure that will contains the message
+	// returns
+	//   false if the queue is empty
+	bool popMessage(TBMessage& message);
+
+	// get the first message received by this task (the background task uses only this one:
+	// the messages handed over to loop() are never taken back)
+	// params
+	//   message: the data structure that will contains the message
+	// returns
+	//   false if the queue is empty
+	bool popReceivedMessage(TBMessage& message);
+
+	// build the sendMessage parameters. The text parameter is the last one and it is left empty:
+	// the URL encoded message must be appended (or written straight to the connection)
+	// params
+	//   id      : the telegram recipient user ID 
+	//   keyboard: the inline/reply keyboard (can be empty)
+	// returns
+	//   the sendMessage parameters, i.e. ?chat_id=123&text=
+	String getMessageParameters(int64_t id, const String& keyboard) const;
+
+	// send a message and check the outcome
+	// params
+	//   id           : the telegram recipient user ID 
+	//   message      : the message to send
+	//   keyboard     : the inline/reply keyboard (can be empty)
+	//   flashKeyboard: the static keyboard stored in flash, NULL if none (keyboard is used)
+	// returns
+	//   true if no error occurred
+	bool sendMessageRequest(int64_t id, const String& message, const String& keyboard, const __FlashStringHelper* flashKeyboard);
+
+	// asynchronous requests: enqueue a new request, start the first queued request
+	// and handle the response of the completed one
+	CTBotAsyncRequest* pushAsyncRequest(void);
+	void startAsyncRequest(void);
+	void completeAsyncRequest(bool isDone);
+
+	// send the first message of the outbound queue allowed by the rate limits (if any)
+	// returns
+	//   true if a message has been sent
+	bool serviceOutbox(void);
+
+	// handle the outcome of a message of the outbound queue
+	// params
+	//   result    : true if the message has been sent
+	//   retryAfter: the retry_after time (seconds) of a 429 response, zero otherwise
+	void completeOutboxMessage(bool result, uint32_t retryAfter);
+
+	// get the rate limit data of a chat
+	// params
+	//   id    : the chat ID
+	//   create: true -> if the chat is not tracked, reuse the least recently limited entry
+	// returns
+	//   the chat rate limit data, NULL if not tracked
+	CTBotChatRate* getChatRate(int64_t id, bool create);
+
+	// fill a message with the data of a received update
+	// params
+	//   update : the JSON of the update
+	//   message: the data structure that will contains the data retrieved
+	// returns
+	//   the message type, CTBotMessageNoData if the update is not handled
+	CTBotMessageType parseUpdate(JsonVariant update, TBMessage& message);
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	CTBotMessageType parseUpdate(JsonVariant update, TBMessageView& message);
+#endif
+
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	// send a command to the Telegram server and deserialize the JSON response straight
+	// from the connection (the response is not stored in a String)
+	// params
+	//   root      : the JSON document that will contains the response
+	//   filter    : the ArduinoJson filter: only the fields in the filter are stored in root
+	//   command   : the command to send, i.e. getMe
+	//   parameters: optional parameters
+	//   text      : (optional) appended to the parameters URL encoded, straight to the connection
+	// returns
+	//   the ArduinoJson deserialization error
+	DeserializationError deserializeCommand(JsonDocument& root, const JsonDocument& filter, const String& command, const String& parameters = "", const String& text = "");
+
+	// send a command with a POST request and a JSON body, then parse the JSON response
+	// straight from the connection
+	// params
+	//   root      : the JSON document that will contains the response
+	//   filter    : the ArduinoJson filter: only the fields in the filter are stored in root
+	//   command   : the command to send, i.e. sendMessage
+	//   body      : the request body
+	//   length    : the body length
+	// returns
+	//   the ArduinoJson deserialization error
+	DeserializationError deserializeCommand(JsonDocument& root, const JsonDocument& filter, const String& command, const Printable& body, size_t length);
+
+	// deserialize a JSON response (and collect its statistics, see getStats())
+	// params
+	//   root  : the JSON document that will contains the response
+	//   input : the response (String or Stream)
+	//   filter: the ArduinoJson filter: only the fields in the filter are stored in root
+	// returns
+	//   the ArduinoJson deserialization error
+	template <typename T>
+	DeserializationError parseResponse(JsonDocument& root, T& input, const JsonDocument& filter);
+
+	// deserialize the update of the current webhook request straight from the connection
+	// params
+	//   root: the JSON document that will contains the update
+	// returns
+	//   the ArduinoJson deserialization error
+	DeserializationError deserializeWebhook(JsonDocument& root);
+
+	// mark as read the first pending update: it doesn't fit the JSON document even alone (i.e. a huge
+	// text), so it would be fetched forever. Only its update_id is parsed
+	// params
+	//   response: the getUpdates response (limit=1) that failed. Empty -> the update is fetched again
+	void skipUpdate(const String& response = "");
+#endif
 
 	// get some information about the bot
 	// params
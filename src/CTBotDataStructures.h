@@ -54,5 +54,53 @@ struct TBMessage {
 	CTBotMessageType messageType;
 };
 
-#endif
+// TBMessage counterparts that reference the strings of the parsed Telegram response instead
+// of copying them: no heap allocation at all (only for ArduinoJson 6). The strings are valid until
+// the next CTBot::getNewMessage() call (or any other CTBot member function that receives updates
+// or tests the connection). The missing fields are empty strings, never NULL
+struct TBUserView {
+	int32_t      id;
+	bool         isBot;
+	const char*  firstName;
+	const char*  lastName;
+	const char*  username;
+	const char*  languageCode;
+};
+
+struct TBGroupView {
+	int64_t      id;
+	const char*  title;
+};
 
+struct TBContactView {
+	const char*  phoneNumber;
+	const char*  firstName;
+	const char*  lastName;
+	int32_t      id;
+	const char*  vCard;
+};
+
+struct TBMessageView {
+	int32_t          messageID;
+	TBUserView       sender;
+	TBGroupView      group;
+	int32_t          date;
+	const char*      text;
+	const char*      chatInstance;
+	const char*      callbackQueryData;
+	const char*      callbackQueryID;
+	TBLocation       location;
+	TBContactView    contact;
+	CTBotMessageType messageType;
+};
+
+// invoked by CTBot::tick() for every message received asynchronously
+typedef void (*CTBotMessageCallback)(TBMessage& message);
+
+// invoked by CTBot::tick() when an asynchronous sendMessage is completed
+// params
+//   id    : the telegram recipient user ID
+//   result: true if no error occurred
+typedef void (*CTBotSendCallback)(int64_t id, bool result);
+
+#endif
@@ -15,9 +15,70 @@
 #define CTBOT_USE_FINGERPRINT          1 // use Telegram fingerprint server validation
                                          // MUST be enabled for ESP8266 Core library > 2.4.2
                                          // Zero -> disabled
-#define CTBOT_CHECK_JSON               1 // Check every JSON received from Telegram Server. Speedup the bot.
-                                         // Zero -> Set it to zero if the bot doesn't receive messages anymore 
-                                         //         slow down the bot
+#define CTBOT_TLS_SESSION_RESUMPTION   1 // reuse the TLS session of the previous connection (abbreviated handshake, only for ESP8266)
+                                         // Zero -> full handshake for every connection
+#ifndef CTBOT_USE_POST
+#define CTBOT_USE_POST                 1 // send the messages with a POST request and a JSON body (no URL encoding)
+                                         // Zero -> GET request, parameters URL encoded in the query string
+#endif
+#define CTBOT_ENDPOINTS_SIZE           4 // max number of Telegram server addresses tracked (fixed IP, resolved and added ones): 2..8
+#define CTBOT_DNS_CACHE_TTL      3600000 // how many milliseconds a resolved address of the Telegram server is cached
+#define CTBOT_DNS_RETRY_INTERVAL   60000 // min milliseconds between two DNS lookups after a failed one
+#define CTBOT_ENDPOINT_BACKOFF      5000 // how many milliseconds an endpoint is skipped after a connect failure
+                                         // doubled at every consecutive failure (up to 32 times)
+#define CTBOT_RESPONSE_TIMEOUT      5000 // how many milliseconds to wait for the Telegram server response
+#define CTBOT_STREAM_BUFFER_SIZE      64 // read buffer size used when a JSON response is parsed straight from the connection
+#define CTBOT_HTTP_LINE_SIZE          64 // max length of a HTTP status/header line (longer lines are truncated)
+#define CTBOT_URLENCODE_CHUNK_SIZE    64 // write buffer size used when a message is URL encoded straight to the connection
+#define CTBOT_HTTP_WRITE_BUFFER_SIZE 256 // write buffer size used when a JSON body is serialized straight to the connection
+#define CTBOT_ASYNC_QUEUE_SIZE         4 // max number of asynchronous requests waiting to be sent
+#define CTBOT_ASYNC_TICK_BUDGET       20 // default time budget (milliseconds) of every CTBot::tick() call
+
+// Outbound message queue (CTBot::queueMessage) -------------------------------------------------------------------
+#define CTBOT_OUTBOX_SIZE              8 // max number of messages waiting in the outbound queue
+#define CTBOT_OUTBOX_CHATS             8 // how many recipients are tracked for the per chat rate limit
+#define CTBOT_OUTBOX_GLOBAL_RATE      30 // max messages per second, all the chats together (Telegram limit)
+#define CTBOT_OUTBOX_CHAT_INTERVAL  1000 // min milliseconds between two messages to the same private chat (Telegram limit)
+#define CTBOT_OUTBOX_GROUP_INTERVAL 3000 // min milliseconds between two messages to the same group chat (Telegram limit: 20 per minute)
+#define CTBOT_OUTBOX_MAX_RETRIES       3 // a message is dropped after this many failures (429 Too Many Requests excluded)
+#define CTBOT_OUTBOX_BACKOFF        1000 // delay (milliseconds) before the first retry, doubled at every retry
+
+// Circuit breaker (CTBot::getCircuitState) -----------------------------------------------------------------------
+#define CTBOT_CIRCUIT_THRESHOLD        3 // consecutive failed requests that open the circuit: the next requests fail fast
+#define CTBOT_CIRCUIT_BACKOFF       2000 // how many milliseconds the circuit stays open before a probe request, doubled at every failed probe
+                                         // a random jitter shortens every delay up to a half
+#define CTBOT_CIRCUIT_MAX_BACKOFF 300000 // max milliseconds the circuit stays open
+#define CTBOT_WIFI_RECONNECT_INTERVAL 10000 // min milliseconds between two WiFi reconnection requests (CTBot::reconnect)
+
+// Background task (CTBot::startBackgroundTask, only for ESP32) ---------------------------------------------------
+#define CTBOT_BACKGROUND_QUEUE_SIZE    8 // max number of messages handed over between the background task and loop() (every direction)
+#define CTBOT_BACKGROUND_STACK_SIZE 8192 // stack size (bytes) of the background task
+#define CTBOT_BACKGROUND_PRIORITY      1 // FreeRTOS priority of the background task
+
+// Webhook server (CTBot::startWebhookServer) ---------------------------------------------------------------------
+#define CTBOT_WEBHOOK_PORT            80 // default TCP port of the webhook server
+#define CTBOT_WEBHOOK_TIMEOUT       2000 // how many milliseconds to wait for the data of a webhook request
+#define CTBOT_WEBHOOK_LINE_SIZE      128 // max length of a webhook request line/header (the secret token header must fit)
+
+#ifndef CTBOT_UPDATES_BATCH_SIZE
+#define CTBOT_UPDATES_BATCH_SIZE       4 // max number of updates fetched with a single getUpdates request
+                                         // bigger values need a bigger CTBOT_JSON6_BUFFER_SIZE
+#endif
+#ifndef CTBOT_UPDATES_QUEUE_SIZE
+#define CTBOT_UPDATES_QUEUE_SIZE       4 // max number of received messages waiting to be read by getNewMessage
+                                         // every queued message takes sizeof(TBMessage) bytes plus its strings
+#endif
+
+#ifndef CTBOT_ENABLE_STATS
+#define CTBOT_ENABLE_STATS             0 // collect per phase timings, byte counts, heap low-water mark and errors (see CTBot::getStats())
+                                         // Zero -> disabled: no code and no memory used
+#endif
+#define CTBOT_STATS_HISTOGRAM_SIZE     8 // buckets of the phase timing histograms (every bucket is 4 times longer than the previous one)
+
+#ifndef CTBOT_ROUTER_SIZE
+#define CTBOT_ROUTER_SIZE             32 // max number of commands and callback query prefixes of a CTBotRouter
+#endif
+#define CTBOT_ROUTER_QUERY_SEPARATOR ':' // separator between the callback query prefix and its arguments (i.e. "light:on")
 
 // Library specific defines: ArduinoJson5 ------------------------------------------------------------------------
 #define CTBOT_JSON5_BUFFER_SIZE        0 // json parser buffer size (only for ArduinoJson 5)
@@ -25,8 +86,16 @@
 #define CTBOT_JSON5_TCP_BUFFER_SIZE  512 // tx/rx wifiClientSecure buffer size for Telegram server connections
                                          // only for ESP8266
 
-// Library specific defines: ArduinoJson5 ------------------------------------------------------------------------
+// Library specific defines: ArduinoJson6 ------------------------------------------------------------------------
 #define CTBOT_JSON6_BUFFER_SIZE     2048 // max size of the dynamic json Document (only for ArduinoJson 6)
+                                         // the responses are filtered: only the fields used by CTBot are stored,
+                                         // but the message texts are (up to 4096 characters each). A batch that doesn't
+                                         // fit is fetched again with fewer updates, a single update that doesn't fit is skipped
+#define CTBOT_JSON6_RESULT_BUFFER_SIZE 256 // size of the json Document (allocated on the stack) of the commands that return only the outcome
+                                         // (sendMessage, answerCallbackQuery...). The received messages are not overwritten
+#define CTBOT_JSON6_KEYBOARD_BUFFER_SIZE CTBOT_JSON6_BUFFER_SIZE // size of the json Document of every keyboard (only for ArduinoJson 6)
+#define CTBOT_JSON6_STATIC_BUFFER      0 // allocate the json Documents statically: no heap allocation at all (only for ArduinoJson 6)
+                                         // Zero -> the json Documents are allocated on the heap, once
 
 
 // value for disabling the status pin. It is utilized for led notification on the board
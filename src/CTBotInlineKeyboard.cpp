@@ -12,26 +12,33 @@ void CTBotInlineKeyboard::initialize()
 	m_buttons = &buttons;
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	m_rows = m_root->createNestedArray("inline_keyboard");
-	m_buttons = m_rows.createNestedArray();
+	if (m_root != NULL) {
+		m_rows = m_root->createNestedArray("inline_keyboard");
+		m_buttons = m_rows.createNestedArray();
+	}
 #endif
 
 	m_isRowEmpty = true;
+	m_isChanged  = true;
 }
 
 CTBotInlineKeyboard::CTBotInlineKeyboard()
 {
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	m_root = new DynamicJsonDocument(CTBOT_JSON6_BUFFER_SIZE);
+#if CTBOT_JSON6_STATIC_BUFFER > 0
+	m_root = &m_document;
+#else
+	m_root = new DynamicJsonDocument(CTBOT_JSON6_KEYBOARD_BUFFER_SIZE);
 	if (!m_root)
 		serialLog("CTBotInlineKeyboard: Unable to allocate JsonDocument memory.\n");
+#endif
 #endif
 
 	initialize();
 }
 
 CTBotInlineKeyboard::~CTBotInlineKeyboard() {
-#if ARDUINOJSON_VERSION_MAJOR == 6
+#if ARDUINOJSON_VERSION_MAJOR == 6 && CTBOT_JSON6_STATIC_BUFFER == 0
 	delete m_root;
 #endif
 };
@@ -42,15 +49,27 @@ void CTBotInlineKeyboard::flushData()
 	m_jsonBuffer.clear();
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	m_root->clear();
+	if (m_root != NULL)
+		m_root->clear();
+	else {
+		// the document has been released: allocate it again
+#if CTBOT_JSON6_STATIC_BUFFER > 0
+		m_root = &m_document;
+#else
+		m_root = new DynamicJsonDocument(CTBOT_JSON6_KEYBOARD_BUFFER_SIZE);
+		if (!m_root)
+			serialLog("CTBotInlineKeyboard: Unable to allocate JsonDocument memory.\n");
+#endif
+	}
 #endif
 
+	m_json = "";
 	initialize();
 }
 
 bool CTBotInlineKeyboard::addRow()
 {
-	if (m_isRowEmpty)
+	if (m_isRowEmpty || (NULL == m_root))
 		return false;
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
@@ -62,6 +81,7 @@ bool CTBotInlineKeyboard::addRow()
 #endif
 
 	m_isRowEmpty = true;
+	m_isChanged  = true;
 	return true;
 }
 
@@ -70,6 +90,8 @@ bool CTBotInlineKeyboard::addButton(String text, String command, CTBotInlineKeyb
 	if ((buttonType != CTBotKeyboardButtonURL) && 
 		(buttonType != CTBotKeyboardButtonQuery))
 		return false;
+	if (NULL == m_root)
+		return false;
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
 	JsonObject& button = m_buttons->createNestedObject();
@@ -78,7 +100,10 @@ bool CTBotInlineKeyboard::addButton(String text, String command, CTBotInlineKeyb
 	JsonObject button = m_buttons.createNestedObject();
 #endif
 
+#if CTBOT_USE_POST == 0
+	// the keyboard is sent in the query string
 	text = URLEncodeMessage(text);
+#endif
 	button["text"] = text;
 	if (CTBotKeyboardButtonURL == buttonType) 
 		button["url"] = command;
@@ -86,20 +111,46 @@ bool CTBotInlineKeyboard::addButton(String text, String command, CTBotInlineKeyb
 		button["callback_data"] = command;
 	if (m_isRowEmpty)
 		m_isRowEmpty = false;
+	m_isChanged = true;
 	return true;
 }
 
-String CTBotInlineKeyboard::getJSON() const
+const String& CTBotInlineKeyboard::getJSON() const
 {
-	String serialized;
+	if (!m_isChanged || (NULL == m_root))
+		return m_json;
 
+	m_json = "";
 #if ARDUINOJSON_VERSION_MAJOR == 5
-	m_root->printTo(serialized);
+	m_json.reserve(m_root->measureLength());
+	m_root->printTo(m_json);
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	serializeJson(*m_root, serialized);
+	m_json.reserve(measureJson(*m_root));
+	serializeJson(*m_root, m_json);
 #endif
 
-	return serialized;
+	m_isChanged = false;
+	return m_json;
+}
+
+void CTBotInlineKeyboard::releaseDocument()
+{
+	if (NULL == m_root)
+		return;
+
+	// build the JSON before freeing the document
+	getJSON();
+
+#if ARDUINOJSON_VERSION_MAJOR == 5
+	m_jsonBuffer.clear();
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	m_root->clear();
+#if CTBOT_JSON6_STATIC_BUFFER == 0
+	delete m_root;
+#endif
+#endif
+	m_root = NULL;
 }
 
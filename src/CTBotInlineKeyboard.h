@@ -25,13 +25,20 @@ private:
 	JsonArray  *m_buttons;
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	DynamicJsonDocument *m_root;
+	JsonDocument *m_root;
+#if CTBOT_JSON6_STATIC_BUFFER > 0
+	StaticJsonDocument<CTBOT_JSON6_KEYBOARD_BUFFER_SIZE> m_document;
+#endif
 	JsonArray m_rows;
 	JsonArray m_buttons;
 #endif
 
 	bool m_isRowEmpty;
 
+	// the serialized keyboard, rebuilt by getJSON() only when the keyboard has been modified
+	mutable String m_json;
+	mutable bool   m_isChanged;
+
 	void initialize(void);
 
 public:
@@ -57,9 +64,15 @@ public:
 
 	// generate a string that contains the inline keyboard formatted in a JSON structure. 
 	// Useful for CTBot::sendMessage()
+	// The JSON is cached: it is serialized again only if the keyboard has been modified
 	// returns:
 	//   the JSON of the inline keyboard 
-	String getJSON(void) const;
+	const String& getJSON(void) const;
+
+	// free the memory used to build the keyboard, keeping only its JSON (see getJSON).
+	// Useful for the keyboards built once and sent many times. Once released, the keyboard
+	// can't be modified (addRow/addButton fail) until flushData() is called
+	void releaseDocument(void);
 };
 
 
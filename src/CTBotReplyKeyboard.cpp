@@ -12,25 +12,32 @@ void CTBotReplyKeyboard::initialize()
 	m_buttons = &buttons;
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	m_rows = m_root->createNestedArray("keyboard");
-	m_buttons = m_rows.createNestedArray();
+	if (m_root != NULL) {
+		m_rows = m_root->createNestedArray("keyboard");
+		m_buttons = m_rows.createNestedArray();
+	}
 #endif
 
 	m_isRowEmpty = true;
+	m_isChanged  = true;
 }
 
 CTBotReplyKeyboard::CTBotReplyKeyboard()
 {
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	m_root = new DynamicJsonDocument(CTBOT_JSON6_BUFFER_SIZE);
+#if CTBOT_JSON6_STATIC_BUFFER > 0
+	m_root = &m_document;
+#else
+	m_root = new DynamicJsonDocument(CTBOT_JSON6_KEYBOARD_BUFFER_SIZE);
 	if (!m_root)
-		serialLog("CTBotInlineKeyboard: Unable to allocate JsonDocument memory.\n");
+		serialLog("CTBotReplyKeyboard: Unable to allocate JsonDocument memory.\n");
+#endif
 #endif
 	initialize();
 }
 
 CTBotReplyKeyboard::~CTBotReplyKeyboard() {
-#if ARDUINOJSON_VERSION_MAJOR == 6
+#if ARDUINOJSON_VERSION_MAJOR == 6 && CTBOT_JSON6_STATIC_BUFFER == 0
 	delete m_root;
 #endif
 };
@@ -41,15 +48,27 @@ void CTBotReplyKeyboard::flushData()
 	m_jsonBuffer.clear();
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	m_root->clear();
+	if (m_root != NULL)
+		m_root->clear();
+	else {
+		// the document has been released: allocate it again
+#if CTBOT_JSON6_STATIC_BUFFER > 0
+		m_root = &m_document;
+#else
+		m_root = new DynamicJsonDocument(CTBOT_JSON6_KEYBOARD_BUFFER_SIZE);
+		if (!m_root)
+			serialLog("CTBotReplyKeyboard: Unable to allocate JsonDocument memory.\n");
+#endif
+	}
 #endif
 
+	m_json = "";
 	initialize();
 }
 
 bool CTBotReplyKeyboard::addRow()
 {
-	if (m_isRowEmpty)
+	if (m_isRowEmpty || (NULL == m_root))
 		return false;
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
@@ -61,6 +80,7 @@ bool CTBotReplyKeyboard::addRow()
 #endif
 
 	m_isRowEmpty = true;
+	m_isChanged  = true;
 	return true;
 }
 
@@ -70,6 +90,8 @@ bool CTBotReplyKeyboard::addButton(String text, CTBotReplyKeyboardButtonType but
 		(buttonType != CTBotKeyboardButtonContact) && 
 		(buttonType != CTBotKeyboardButtonLocation))
 		return false;
+	if (NULL == m_root)
+		return false;
 
 #if ARDUINOJSON_VERSION_MAJOR == 5
 	JsonObject& button = m_buttons->createNestedObject();
@@ -78,7 +100,10 @@ bool CTBotReplyKeyboard::addButton(String text, CTBotReplyKeyboardButtonType but
 	JsonObject button = m_buttons.createNestedObject();
 #endif
 
+#if CTBOT_USE_POST == 0
+	// the keyboard is sent in the query string
 	text = URLEncodeMessage(text);
+#endif
 	button["text"] = text;
 
 	if (CTBotKeyboardButtonContact == buttonType)
@@ -88,32 +113,67 @@ bool CTBotReplyKeyboard::addButton(String text, CTBotReplyKeyboardButtonType but
 
 	if (m_isRowEmpty)
 		m_isRowEmpty = false;
+	m_isChanged = true;
 	return true;
 }
 
 void CTBotReplyKeyboard::enableResize() {
+	if (NULL == m_root)
+		return;
 	(*m_root)["resize_keyboard"] = true;
+	m_isChanged = true;
 }
 
 void CTBotReplyKeyboard::enableOneTime() {
+	if (NULL == m_root)
+		return;
 	(*m_root)["one_time_keyboard"] = true;
+	m_isChanged = true;
 }
 
 void CTBotReplyKeyboard::enableSelective() {
+	if (NULL == m_root)
+		return;
 	(*m_root)["selective"] = true;
+	m_isChanged = true;
 }
 
-String CTBotReplyKeyboard::getJSON() const
+const String& CTBotReplyKeyboard::getJSON() const
 {
-	String serialized;
+	if (!m_isChanged || (NULL == m_root))
+		return m_json;
 
+	m_json = "";
 #if ARDUINOJSON_VERSION_MAJOR == 5
-	m_root->printTo(serialized);
+	m_json.reserve(m_root->measureLength());
+	m_root->printTo(m_json);
 #endif
 #if ARDUINOJSON_VERSION_MAJOR == 6
-	serializeJson(*m_root, serialized);
+	m_json.reserve(measureJson(*m_root));
+	serializeJson(*m_root, m_json);
 #endif
 
-	return serialized;
+	m_isChanged = false;
+	return m_json;
+}
+
+void CTBotReplyKeyboard::releaseDocument()
+{
+	if (NULL == m_root)
+		return;
+
+	// build the JSON before freeing the document
+	getJSON();
+
+#if ARDUINOJSON_VERSION_MAJOR == 5
+	m_jsonBuffer.clear();
+#endif
+#if ARDUINOJSON_VERSION_MAJOR == 6
+	m_root->clear();
+#if CTBOT_JSON6_STATIC_BUFFER == 0
+	delete m_root;
+#endif
+#endif
+	m_root = NULL;
 }
 
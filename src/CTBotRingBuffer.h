@@ -0,0 +1,82 @@
+#pragma once
+#ifndef CTBOT_RING_BUFFER
+#define CTBOT_RING_BUFFER
+
+#include <stdint.h>
+#include <atomic>
+#include <utility>
+
+// lock-free single producer/single consumer queue: one task (or thread) pushes, another one pops,
+// without any mutex. The items are moved in and out, so a String member is handed over without copies.
+// No Arduino dependency: the same code can be exercised on a PC with two std::thread
+// T       : the item type (default constructible and move assignable)
+// capacity: max number of queued items
+template <typename T, uint8_t capacity>
+class CTBotRingBuffer
+{
+public:
+	// enqueue an item. Only the producer can call it
+	// params
+	//   item: the item to enqueue (moved)
+	// returns
+	//   false if the queue is full (the item is left untouched)
+	bool push(T& item) {
+		uint8_t head = m_head.load(std::memory_order_relaxed);
+		uint8_t next = advance(head);
+		if (next == m_tail.load(std::memory_order_acquire))
+			return false;
+		m_items[head] = std::move(item);
+		// publish the item to the consumer
+		m_head.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// dequeue an item. Only the consumer can call it
+	// params
+	//   item: where to move the dequeued item
+	// returns
+	//   false if the queue is empty
+	bool pop(T& item) {
+		uint8_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire))
+			return false;
+		item = std::move(m_items[tail]);
+		// hand the slot back to the producer
+		m_tail.store(advance(tail), std::memory_order_release);
+		return true;
+	}
+
+	// get how many items are queued. Exact only if called by the producer or the consumer
+	// while the other side is idle, otherwise a snapshot
+	// returns
+	//   the number of queued items
+	uint8_t size(void) const {
+		uint8_t head = m_head.load(std::memory_order_acquire);
+		uint8_t tail = m_tail.load(std::memory_order_acquire);
+		return (head >= tail) ? head - tail : head + capacity + 1 - tail;
+	}
+
+	// check if an item can be pushed. Reliable only for the producer
+	bool isFull(void) const {
+		return advance(m_head.load(std::memory_order_relaxed)) == m_tail.load(std::memory_order_acquire);
+	}
+
+	// check if an item can be popped. Reliable only for the consumer
+	bool isEmpty(void) const {
+		return m_tail.load(std::memory_order_relaxed) == m_head.load(std::memory_order_acquire);
+	}
+
+private:
+	static_assert((capacity > 0) && (capacity < UINT8_MAX), "CTBotRingBuffer: capacity must be 1..254");
+
+	// one slot is always left empty, to tell a full queue from an empty one
+	T m_items[capacity + 1];
+	std::atomic<uint8_t> m_head{ 0 }; // next slot to write, owned by the producer
+	std::atomic<uint8_t> m_tail{ 0 }; // next slot to read, owned by the consumer
+
+	static uint8_t advance(uint8_t index) {
+		return (index == capacity) ? 0 : index + 1;
+	}
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "CTBotRouter.h"
+#include "Utilities.h"
+
+CTBotRouter::CTBotRouter()
+{
+	m_routeCount = 0;
+	m_botName    = NULL; // any @botname accepted
+}
+
+uint32_t CTBotRouter::hash(const char* name, uint8_t length)
+{
+	uint32_t value = 2166136261UL;
+	for (uint8_t i = 0; i < length; i++) {
+		uint8_t c = name[i];
+		if ((c >= 'A') && (c <= 'Z'))
+			c += 32;
+		value = (value ^ c) * 16777619UL;
+	}
+	return value;
+}
+
+void CTBotRouter::setBotName(const char* botName)
+{	m_botName = botName;}
+
+bool CTBotRouter::addCommand(const char* command, CTBotCommandHandler handler)
+{	return addRoute(command, CTBotMessageText, handler, NULL);}
+
+bool CTBotRouter::addCommand(const char* command, CTBotCommandViewHandler handler)
+{	return addRoute(command, CTBotMessageText, NULL, handler);}
+
+bool CTBotRouter::addQuery(const char* prefix, CTBotCommandHandler handler)
+{	return addRoute(prefix, CTBotMessageQuery, handler, NULL);}
+
+bool CTBotRouter::addQuery(const char* prefix, CTBotCommandViewHandler handler)
+{	return addRoute(prefix, CTBotMessageQuery, NULL, handler);}
+
+void CTBotRouter::clear()
+{	m_routeCount = 0;}
+
+bool CTBotRouter::addRoute(const char* name, CTBotMessageType type, CTBotCommandHandler handler, CTBotCommandViewHandler viewHandler)
+{
+	if (NULL == name)
+		return false;
+	if ((CTBotMessageText == type) && ('/' == name[0]))
+		name++;
+
+	size_t length = strlen(name);
+	if ((0 == length) || (length > UINT8_MAX)) {
+		serialLog("CTBotRouter: invalid name length\n");
+		return false;
+	}
+	if (m_routeCount == CTBOT_ROUTER_SIZE) {
+		serialLog("CTBotRouter: routing table full\n");
+		return false;
+	}
+	if (findRoute(name, length, type) != NULL) {
+		serialLog("CTBotRouter: already routed: ");
+		serialLog(name);
+		serialLog("\n");
+		return false;
+	}
+
+	// insertion sort: the routes are added once, at startup
+	uint32_t value = hash(name, length);
+	uint8_t position = m_routeCount;
+	while ((position > 0) && (m_routes[position - 1].hash > value)) {
+		m_routes[position] = m_routes[position - 1];
+		position--;
+	}
+
+	m_routes[position].hash        = value;
+	m_routes[position].name        = name;
+	m_routes[position].length      = length;
+	m_routes[position].type        = type;
+	m_routes[position].handler     = handler;
+	m_routes[position].viewHandler = viewHandler;
+	m_routeCount++;
+	return true;
+}
+
+const CTBotRouter::CTBotRoute* CTBotRouter::findRoute(const char* name, uint8_t length, CTBotMessageType type) const
+{
+	uint32_t value = hash(name, length);
+
+	// binary search of the first route with the same hash
+	uint8_t first = 0;
+	uint8_t last  = m_routeCount;
+	while (first < last) {
+		uint8_t middle = first + (last - first) / 2;
+		if (m_routes[middle].hash < value)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	// the collisions (and the same name used for a command and a query) are adjacent
+	for (; (first < m_routeCount) && (m_routes[first].hash == value); first++) {
+		const CTBotRoute& route = m_routes[first];
+		if ((route.type == type) && (route.length == length) && (0 == strncasecmp(route.name, name, length)))
+			return &route;
+	}
+	return NULL;
+}
+
+const CTBotRouter::CTBotRoute* CTBotRouter::match(const char* text, CTBotMessageType type, const char*& args) const
+{
+	if ((NULL == text) || (0 == m_routeCount))
+		return NULL;
+
+	const char* name = text;
+	const char* end;
+	if (CTBotMessageText == type) {
+		// "/command[@botname][ arguments]"
+		if (text[0] != '/')
+			return NULL;
+		name++;
+		end = name;
+		while ((*end != '\0') && (*end != ' ') && (*end != '\n') && (*end != '@'))
+			end++;
+		args = end;
+		if ('@' == *end) {
+			const char* botName = end + 1;
+			args = botName;
+			while ((*args != '\0') && (*args != ' ') && (*args != '\n'))
+				args++;
+			// addressed to another bot
+			if ((m_botName != NULL) && ((strlen(m_botName) != (size_t)(args - botName)) ||
+				(strncasecmp(m_botName, botName, args - botName) != 0)))
+				return NULL;
+		}
+		while ((' ' == *args) || ('\n' == *args))
+			args++;
+	}
+	else {
+		// "prefix[<separator>arguments]"
+		end = name;
+		while ((*end != '\0') && (*end != CTBOT_ROUTER_QUERY_SEPARATOR))
+			end++;
+		args = ('\0' == *end) ? end : end + 1;
+	}
+
+	if ((end == name) || (end - name > UINT8_MAX))
+		return NULL;
+	return findRoute(name, end - name, type);
+}
+
+bool CTBotRouter::dispatch(TBMessage& message) const
+{
+	const char* text;
+	if (CTBotMessageText == message.messageType)
+		text = message.text.c_str();
+	else if (CTBotMessageQuery == message.messageType)
+		text = message.callbackQueryData.c_str();
+	else
+		return false;
+
+	const char* args;
+	const CTBotRoute* route = match(text, message.messageType, args);
+	if ((NULL == route) || (NULL == route->handler))
+		return false;
+	route->handler(message, args);
+	return true;
+}
+
+bool CTBotRouter::dispatch(TBMessageView& message) const
+{
+	const char* text;
+	if (CTBotMessageText == message.messageType)
+		text = message.text;
+	else if (CTBotMessageQuery == message.messageType)
+		text = message.callbackQueryData;
+	else
+		return false;
+
+	const char* args;
+	const CTBotRoute* route = match(text, message.messageType, args);
+	if ((NULL == route) || (NULL == route->viewHandler))
+		return false;
+	route->viewHandler(message, args);
+	return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#ifndef CTBOT_ROUTER
+#define CTBOT_ROUTER
+
+#include <Arduino.h>
+#include "CTBotDataStructures.h"
+#include "CTBotDefines.h"
+
+// case insensitive FNV-1a hash of a command name, usable at compile time. It is the hash
+// used by CTBotRouter, i.e.
+//   switch (CTBotRouter::hash(name, length)) { case CTBotHash("start"): ... }
+// params
+//   name: the command name (null terminated)
+//   hash: the hash of the previous characters (leave the default value)
+// returns
+//   the hash of the name
+constexpr uint32_t CTBotHash(const char* name, uint32_t hash = 2166136261UL) {
+	return ('\0' == *name) ? hash :
+		CTBotHash(name + 1, (hash ^ (uint8_t)(((*name >= 'A') && (*name <= 'Z')) ? *name + 32 : *name)) * 16777619UL);
+}
+
+// invoked by the router for a matching command/callback query
+// params
+//   message: the received message
+//   args   : the command arguments (the text after the command, leading spaces skipped) or
+//            the callback query data after the CTBOT_ROUTER_QUERY_SEPARATOR. Empty string if none
+typedef void (*CTBotCommandHandler)(TBMessage& message, const char* args);
+typedef void (*CTBotCommandViewHandler)(TBMessageView& message, const char* args);
+
+// dispatch the received messages to their handlers:
+// - text messages starting with a /command (i.e. "/light on" or "/light@myBot on")
+// - callback queries whose data starts with a prefix followed by the CTBOT_ROUTER_QUERY_SEPARATOR
+//   (i.e. "light:on") or that is the prefix itself
+// The names are case insensitive. The routes are kept sorted by hash, so a lookup costs a single
+// pass over the name plus a binary search: no string is copied and no memory is allocated.
+// Attach it with CTBot::setRouter(): getNewMessage() then returns only the unrouted messages
+class CTBotRouter
+{
+private:
+	struct CTBotRoute {
+		uint32_t                hash;
+		const char*             name;
+		uint8_t                 length;
+		CTBotMessageType        type;        // CTBotMessageText (command) or CTBotMessageQuery
+		CTBotCommandHandler     handler;
+		CTBotCommandViewHandler viewHandler;
+	};
+
+	CTBotRoute  m_routes[CTBOT_ROUTER_SIZE]; // sorted by hash
+	uint8_t     m_routeCount;
+	const char* m_botName;
+
+	// add a route, keeping the table sorted
+	bool addRoute(const char* name, CTBotMessageType type, CTBotCommandHandler handler, CTBotCommandViewHandler viewHandler);
+
+	// search a route
+	// params
+	//   name  : the name to search (not null terminated)
+	//   length: the name length
+	//   type  : CTBotMessageText or CTBotMessageQuery
+	// returns
+	//   the route, NULL if not found
+	const CTBotRoute* findRoute(const char* name, uint8_t length, CTBotMessageType type) const;
+
+	// split the text of a message or the data of a callback query into name and arguments, then search the route
+	// params
+	//   text: the text/data of the message
+	//   type: CTBotMessageText or CTBotMessageQuery
+	//   args: where to store the arguments pointer
+	// returns
+	//   the route, NULL if not found
+	const CTBotRoute* match(const char* text, CTBotMessageType type, const char*& args) const;
+
+public:
+	CTBotRouter();
+
+	// case insensitive hash of a name (same result of CTBotHash)
+	// params
+	//   name  : the name (not null terminated)
+	//   length: the name length
+	// returns
+	//   the hash of the name
+	static uint32_t hash(const char* name, uint8_t length);
+
+	// set the bot username: the commands addressed to another bot (i.e. "/start@otherBot" in a group)
+	// are not dispatched. If not set, any @botname suffix is ignored
+	// params
+	//   botName: the bot username, without the @ (must stay valid, i.e. a string literal)
+	void setBotName(const char* botName);
+
+	// add a /command
+	// params
+	//   command: the command name, with or without the leading slash (must stay valid, i.e. a string literal)
+	//   handler: the function invoked when the command is received
+	// returns
+	//   false if the routing table is full (see CTBOT_ROUTER_SIZE) or the command is already routed
+	bool addCommand(const char* command, CTBotCommandHandler handler);
+	bool addCommand(const char* command, CTBotCommandViewHandler handler);
+
+	// add a callback query prefix
+	// params
+	//   prefix : the callback data prefix (must stay valid, i.e. a string literal)
+	//   handler: the function invoked when a matching callback query is received
+	// returns
+	//   false if the routing table is full (see CTBOT_ROUTER_SIZE) or the prefix is already routed
+	bool addQuery(const char* prefix, CTBotCommandHandler handler);
+	bool addQuery(const char* prefix, CTBotCommandViewHandler handler);
+
+	// remove all the routes
+	void clear(void);
+
+	// invoke the handler of a message
+	// params
+	//   message: the received message
+	// returns
+	//   true if the message has been handled
+	bool dispatch(TBMessage& message) const;
+	bool dispatch(TBMessageView& message) const;
+};
+
+#endif
@@ -1,14 +1,77 @@
 #include <WiFiClientSecure.h>
+#include <utility>
+#if defined(ARDUINO_ARCH_ESP8266) // ESP8266
+#include <ESP8266WiFi.h>
+#elif defined(ARDUINO_ARCH_ESP32) // ESP32
+#include <WiFi.h>
+#endif
 #include "CTBotSecureConnection.h"
 #include "Utilities.h"
 
+static_assert(CTBOT_ENDPOINTS_SIZE >= 2, "CTBOT_ENDPOINTS_SIZE: the fixed IP plus at least one replaceable endpoint");
+static_assert(CTBOT_ENDPOINTS_SIZE <= 8, "CTBOT_ENDPOINTS_SIZE: the tried endpoints are tracked with an 8 bit mask");
+static_assert(CTBOT_STREAM_BUFFER_SIZE <= UINT16_MAX, "CTBOT_STREAM_BUFFER_SIZE: the response stream buffer is indexed with 16 bit");
+static_assert(CTBOT_HTTP_WRITE_BUFFER_SIZE <= UINT16_MAX, "CTBOT_HTTP_WRITE_BUFFER_SIZE: the write buffer is indexed with 16 bit");
+
 constexpr const char* const TELEGRAM_URL = "api.telegram.org";
 constexpr const char* const TELEGRAM_IP = "149.154.167.220";
 constexpr uint32_t TELEGRAM_PORT = 443;
+constexpr uint16_t READ_BUFFER_SIZE = 128; // bulk read size of the response body
+
+// buffers the small writes (i.e. a JSON serialized one character at a time) into bigger ones
+class CTBotBufferedWriter : public Print
+{
+public:
+	explicit CTBotBufferedWriter(Print& output) : m_output(output) {}
+	~CTBotBufferedWriter() { flush(); }
+
+	size_t write(uint8_t value) override {
+		if (CTBOT_HTTP_WRITE_BUFFER_SIZE == m_length)
+			flush();
+		m_buffer[m_length++] = value;
+		return 1;
+	}
+	using Print::write;
+
+	void flush() override {
+		if ((m_length > 0) && (m_output.write(m_buffer, m_length) != m_length))
+			m_isFailed = true;
+		m_length = 0;
+	}
+
+	// check if some bytes could not be written (i.e. the connection has been closed)
+	bool isFailed() const {
+		return m_isFailed;
+	}
+
+private:
+	Print&   m_output;
+	uint8_t  m_buffer[CTBOT_HTTP_WRITE_BUFFER_SIZE];
+	uint16_t m_length{ 0 };
+	bool     m_isFailed{ false };
+};
+
+// a request body already serialized in a String
+class CTBotStringBody : public Printable
+{
+public:
+	explicit CTBotStringBody(const String& body) : m_body(body) {}
+
+	size_t printTo(Print& output) const override {
+		return output.print(m_body);
+	}
+
+private:
+	const String& m_body;
+};
 
 CTBotSecureConnection::CTBotSecureConnection() {
 	if (m_statusPin != CTBOT_DISABLE_STATUS_PIN)
 		pinMode(m_statusPin, OUTPUT);
+	addEndpoint(TELEGRAM_IP);
+#if CTBOT_ENABLE_STATS > 0
+	m_stats.reset();
+#endif
 }
 
 bool CTBotSecureConnection::useDNS(bool value)
@@ -28,6 +91,207 @@ bool CTBotSecureConnection::useDNS(bool value)
 	return true;
 }
 
+bool CTBotSecureConnection::addEndpoint(const String& ip)
+{
+	IPAddress address;
+	if (!address.fromString(ip)) {
+		serialLog("addEndpoint: invalid IP address\n");
+		return false;
+	}
+	storeEndpoint(address, false);
+	return true;
+}
+
+CTBotSecureConnection::CTBotEndpoint& CTBotSecureConnection::storeEndpoint(const IPAddress& ip, bool isResolved)
+{
+	uint8_t index = 0;
+	while ((index < m_endpointCount) && !(m_endpoints[index].ip == ip))
+		index++;
+
+	if (index == m_endpointCount) {
+		if (m_endpointCount < CTBOT_ENDPOINTS_SIZE)
+			m_endpointCount++;
+		else {
+			// replace the least healthy endpoint (most failures, then slowest). The fixed IP is kept
+			index = 1;
+			for (uint8_t i = 2; i < m_endpointCount; i++) {
+				if ((m_endpoints[i].failures > m_endpoints[index].failures) ||
+					((m_endpoints[i].failures == m_endpoints[index].failures) && (m_endpoints[i].latency > m_endpoints[index].latency)))
+					index = i;
+			}
+		}
+		m_endpoints[index].ip         = ip;
+		m_endpoints[index].retryAfter = 0;
+		m_endpoints[index].latency    = 0; // not measured: tried first
+		m_endpoints[index].failures   = 0;
+		m_endpoints[index].isResolved = false;
+	}
+
+	CTBotEndpoint& endpoint = m_endpoints[index];
+	if (isResolved) {
+		endpoint.isResolved = true;
+		endpoint.expires    = millis() + CTBOT_DNS_CACHE_TTL;
+	}
+	return endpoint;
+}
+
+void CTBotSecureConnection::resolveEndpoints()
+{
+	uint32_t now = millis();
+
+	// the cached address is still valid, or the last lookup failed a short time ago
+	for (uint8_t i = 0; i < m_endpointCount; i++) {
+		if (m_endpoints[i].isResolved && ((int32_t)(now - m_endpoints[i].expires) < 0))
+			return;
+	}
+	if ((int32_t)(now - m_nextLookup) < 0)
+		return;
+
+	IPAddress ip;
+	if (WiFi.hostByName(TELEGRAM_URL, ip) != 1) {
+		// the expired addresses (if any) and the fixed IP are used in the meanwhile
+		serialLog("\nDNS lookup of the Telegram server failed\n");
+		m_nextLookup = now + CTBOT_DNS_RETRY_INTERVAL;
+		return;
+	}
+	storeEndpoint(ip, true);
+}
+
+int8_t CTBotSecureConnection::selectEndpoint(uint8_t tried) const
+{
+	uint32_t now = millis();
+	int8_t best = -1;
+
+	for (uint8_t i = 0; i < m_endpointCount; i++) {
+		const CTBotEndpoint& endpoint = m_endpoints[i];
+		if ((tried & (1 << i)) || ((endpoint.failures > 0) && ((int32_t)(now - endpoint.retryAfter) < 0)))
+			continue;
+		if (best < 0) {
+			best = i;
+			continue;
+		}
+		const CTBotEndpoint& current = m_endpoints[best];
+		bool isHealthy = (0 == endpoint.failures);
+		if ((isHealthy && (current.failures > 0)) ||
+			((isHealthy == (0 == current.failures)) && (endpoint.latency < current.latency)))
+			best = i;
+	}
+	return best;
+}
+
+bool CTBotSecureConnection::connectEndpoint(uint8_t index)
+{
+	CTBotEndpoint& endpoint = m_endpoints[index];
+	uint32_t start = millis();
+
+	// the resolved endpoint is connected by name, so the TLS handshake sends the server name (SNI):
+	// the lookup of the core is answered by its own DNS cache. The fixed and the added IPs by address
+	bool isConnected;
+	if (endpoint.isResolved)
+		isConnected = m_client->connect(TELEGRAM_URL, TELEGRAM_PORT);
+	else
+		isConnected = m_client->connect(endpoint.ip, TELEGRAM_PORT);
+
+	if (isConnected) {
+		uint32_t elapsed = millis() - start;
+		if (elapsed > UINT16_MAX)
+			elapsed = UINT16_MAX;
+		else if (0 == elapsed)
+			elapsed = 1; // zero means not measured
+		// exponential moving average: a single slow handshake doesn't demote the endpoint
+		endpoint.latency  = (0 == endpoint.latency) ? elapsed : ((uint32_t)endpoint.latency * 3 + elapsed) / 4;
+		endpoint.failures = 0;
+		return true;
+	}
+
+	m_client->stop();
+	if (endpoint.failures < UINT8_MAX)
+		endpoint.failures++;
+	uint8_t shift = (endpoint.failures > 6) ? 5 : endpoint.failures - 1;
+	endpoint.retryAfter = millis() + ((uint32_t)CTBOT_ENDPOINT_BACKOFF << shift);
+	serialLog("\nUnable to connect to the endpoint ");
+	serialLog(endpoint.ip.toString());
+	serialLog("\n");
+	return false;
+}
+
+CTBotCircuitState CTBotSecureConnection::getCircuitState() const
+{
+	return m_circuitState;
+}
+
+uint32_t CTBotSecureConnection::getCircuitRetryDelay() const
+{
+	if (m_circuitState != CTBotCircuitOpen)
+		return 0;
+	int32_t remaining = m_circuitRetryAt - millis();
+	return (remaining > 0) ? remaining : 0;
+}
+
+void CTBotSecureConnection::resetCircuit()
+{
+	m_circuitState    = CTBotCircuitClosed;
+	m_circuitFailures = 0;
+	m_circuitTrips    = 0;
+}
+
+bool CTBotSecureConnection::checkCircuit()
+{
+	// the WiFi status is checked only with the built-in client: a custom transport may use another link
+	if (m_client == &m_telegramServer) {
+		if (WiFi.status() != WL_CONNECTED) {
+			m_isWifiDown = true;
+			serialLog("\nWiFi not connected\n");
+			CTBOT_STATS_ERROR(m_stats, CTBotStatsErrorRefused);
+			return false;
+		}
+		// the WiFi is back: the failures were (likely) caused by its drop, probe the server immediately
+		if (m_isWifiDown) {
+			m_isWifiDown = false;
+			resetCircuit();
+		}
+	}
+
+	if (m_circuitState != CTBotCircuitOpen)
+		return true;
+	if ((int32_t)(millis() - m_circuitRetryAt) < 0) {
+		CTBOT_STATS_ERROR(m_stats, CTBotStatsErrorRefused);
+		return false;
+	}
+	serialLog("\nCircuit half open: probing the Telegram server\n");
+	m_circuitState = CTBotCircuitHalfOpen;
+	return true;
+}
+
+void CTBotSecureConnection::recordOutcome(bool isReachable)
+{
+	if (isReachable) {
+		if (m_circuitState != CTBotCircuitClosed)
+			serialLog("\nCircuit closed\n");
+		resetCircuit();
+		return;
+	}
+
+	if (m_circuitFailures < UINT8_MAX)
+		m_circuitFailures++;
+	if ((m_circuitState != CTBotCircuitHalfOpen) && (m_circuitFailures < CTBOT_CIRCUIT_THRESHOLD))
+		return;
+
+	uint32_t backoff = CTBOT_CIRCUIT_BACKOFF;
+	for (uint8_t i = 0; (i < m_circuitTrips) && (backoff < CTBOT_CIRCUIT_MAX_BACKOFF); i++)
+		backoff *= 2;
+	if (backoff > CTBOT_CIRCUIT_MAX_BACKOFF)
+		backoff = CTBOT_CIRCUIT_MAX_BACKOFF;
+	if (m_circuitTrips < UINT8_MAX)
+		m_circuitTrips++;
+	// jitter: the boards restarted together (i.e. after a power outage) don't probe the server all at once
+	backoff -= random(backoff / 2 + 1);
+
+	serialLog("\nCircuit open: too many failed requests\n");
+	m_circuitRetryAt = millis() + backoff;
+	m_circuitState   = CTBotCircuitOpen;
+}
+
 void CTBotSecureConnection::setFingerprint(const uint8_t* newFingerprint)
 {
 	for (int i = 0; i < 20; i++)
@@ -44,110 +308,758 @@ void CTBotSecureConnection::setStatusPin(int8_t pin)
 
 }
 
-String CTBotSecureConnection::send(const String& message) const
+void CTBotSecureConnection::useKeepAlive(bool value)
 {
+	m_useKeepAlive = value;
+	if (!m_useKeepAlive)
+		disconnect();
+}
+
+uint32_t CTBotSecureConnection::getHandshakeCount() const
+{
+	return m_handshakes;
+}
+
+uint32_t CTBotSecureConnection::getReconnectCount() const
+{
+	return m_reconnects;
+}
+
+uint32_t CTBotSecureConnection::getResumedHandshakeCount() const
+{
+	return m_resumedHandshakes;
+}
+
+void CTBotSecureConnection::setResponseTimeout(uint32_t timeout)
+{
+	m_responseTimeout = timeout;
+}
+
+#if CTBOT_ENABLE_STATS > 0
+CTBotStats& CTBotSecureConnection::getStats()
+{
+	return m_stats;
+}
+
+const CTBotStats& CTBotSecureConnection::getStats() const
+{
+	return m_stats;
+}
+#endif
+
+void CTBotSecureConnection::setTransport(Client* client)
+{
+	disconnect();
+	if (NULL == client)
+		m_client = &m_telegramServer;
+	else
+		m_client = client;
+}
+
+void CTBotSecureConnection::disconnect()
+{
+	m_client->stop();
+	m_isLinkOpen = false;
+}
+
+bool CTBotSecureConnection::connect()
+{
+	// reuse the kept alive connection, if still open
+	if (m_useKeepAlive && m_isLinkOpen && m_client->connected())
+		return true;
+
+	// release the resources of the previous connection (if any)
+	m_client->stop();
+
+	// a custom transport (see setTransport()) is used as is
+	if (m_client == &m_telegramServer) {
 #if defined(ARDUINO_ARCH_ESP8266) && CTBOT_USE_FINGERPRINT == 0 // ESP8266 no HTTPS verification
-	WiFiClientSecure telegramServer;
-	telegramServer.setInsecure();
-	serialLog("ESP8266 no https verification");
+		m_telegramServer.setInsecure();
+		serialLog("ESP8266 no https verification");
 #elif defined(ARDUINO_ARCH_ESP8266) && CTBOT_USE_FINGERPRINT == 1 // ESP8266 with HTTPS verification
-	BearSSL::WiFiClientSecure telegramServer;
-	telegramServer.setFingerprint(m_fingerprint);
-	serialLog("ESP8266 with https verification");
+		m_telegramServer.setFingerprint(m_fingerprint);
+		serialLog("ESP8266 with https verification");
 #elif defined(ARDUINO_ARCH_ESP32) // ESP32
-	WiFiClientSecure telegramServer;
-	serialLog("ESP32");
+		serialLog("ESP32");
 #endif
 
 #if defined(ARDUINO_ARCH_ESP8266) // only for ESP8266 reduce drastically the heap usage
-	telegramServer.setBufferSizes(CTBOT_JSON5_TCP_BUFFER_SIZE, CTBOT_JSON5_TCP_BUFFER_SIZE);
+		m_telegramServer.setBufferSizes(CTBOT_JSON5_TCP_BUFFER_SIZE, CTBOT_JSON5_TCP_BUFFER_SIZE);
 #endif
+#if defined(ARDUINO_ARCH_ESP8266) && CTBOT_TLS_SESSION_RESUMPTION > 0
+		// offer the session of the previous connection: if the server accepts it, the handshake is abbreviated.
+		// The session is updated by the client at every successful handshake
+		m_telegramServer.setSession(&m_session);
+#endif
+	}
 
-	// check for using symbolic URLs
-	if (m_useDNS) {
-		// try to connect with URL
-		if (!telegramServer.connect(TELEGRAM_URL, TELEGRAM_PORT)) {
-			// no way, try to connect with fixed IP
-			IPAddress telegramServerIP;
-			telegramServerIP.fromString(TELEGRAM_IP);
-			if (!telegramServer.connect(telegramServerIP, TELEGRAM_PORT)) {
-				serialLog("\nUnable to connect to Telegram server! (use-DNS-mode)\n");
-				return {};
-			}
-			else {
-				serialLog("\nConnected using fixed IP\n");
-			}
+#if defined(ARDUINO_ARCH_ESP8266) && CTBOT_TLS_SESSION_RESUMPTION > 0
+	// the server resumes a session by answering with the same session ID
+	uint8_t sessionID[sizeof(m_session.getSession()->session_id)];
+	uint8_t sessionIDLength = m_session.getSession()->session_id_len;
+	memcpy(sessionID, m_session.getSession()->session_id, sessionIDLength);
+#endif
+
+	CTBOT_STATS_START(start);
+
+	// refresh the resolved address (if expired), then try the endpoints from the fastest healthy one
+	if (m_useDNS)
+		resolveEndpoints();
+	uint8_t tried = 0;
+	int8_t index;
+	bool isConnected = false;
+	while (!isConnected && ((index = selectEndpoint(tried)) >= 0)) {
+		tried |= 1 << index;
+		isConnected = connectEndpoint(index);
+	}
+	// all the endpoints are backing off: try the one that failed first, the others are left alone
+	if (!isConnected && (0 == tried)) {
+		index = 0;
+		for (uint8_t i = 1; i < m_endpointCount; i++) {
+			if ((int32_t)(m_endpoints[i].retryAfter - m_endpoints[index].retryAfter) < 0)
+				index = i;
 		}
-		else {
-			serialLog("\nConnected using DNS\n");
+		isConnected = connectEndpoint(index);
+	}
+	if (!isConnected) {
+		serialLog("\nUnable to connect to Telegram server!\n");
+		CTBOT_STATS_ERROR(m_stats, CTBotStatsErrorConnect);
+		return false;
+	}
+
+	CTBOT_STATS_RECORD(m_stats, CTBotStatsConnect, start);
+
+#if defined(ARDUINO_ARCH_ESP8266) && CTBOT_TLS_SESSION_RESUMPTION > 0
+	if ((m_client == &m_telegramServer) && (sessionIDLength > 0) &&
+		(sessionIDLength == m_session.getSession()->session_id_len) &&
+		(0 == memcmp(sessionID, m_session.getSession()->session_id, sessionIDLength))) {
+		m_resumedHandshakes++;
+		serialLog("TLS session resumed\n");
+	}
+#endif
+
+	// a kept alive connection was expected to be open: the link has been dropped
+	if (m_isLinkOpen)
+		m_reconnects++;
+	m_handshakes++;
+	m_isLinkOpen = m_useKeepAlive;
+	return true;
+}
+
+bool CTBotSecureConnection::sendRequest(const String& message, const String& text)
+{
+	return sendHTTPRequest(message, text, NULL, 0);
+}
+
+bool CTBotSecureConnection::sendRequest(const String& message, const Printable& body, size_t length)
+{
+	return sendHTTPRequest(message, "", &body, length);
+}
+
+bool CTBotSecureConnection::sendHTTPRequest(const String& message, const String& text, const Printable* body, size_t length)
+{
+	// a kept alive connection may have been silently closed by the server: in this case the request
+	// is sent again (once) with a brand new connection, only if the server can't have handled it (the
+	// write failed or the connection was closed without any answer). A timeout is never retried:
+	// the server may have received the request, i.e. a message would be sent twice
+	bool isReused = m_useKeepAlive && m_isLinkOpen && m_client->connected();
+	uint8_t attempts = isReused ? 2 : 1;
+
+	if (isBusy()) {
+		serialLog("\nAn asynchronous request is in progress\n");
+		return false;
+	}
+
+	// fail fast: no connection attempt (and no connect timeout) while the circuit is open
+	if (!checkCircuit())
+		return false;
+
+	m_responseStream.reset();
+	while (attempts > 0) {
+		attempts--;
+
+		if (!connect()) {
+			recordOutcome(false);
+			return false;
+		}
+
+		if (m_statusPin != CTBOT_DISABLE_STATUS_PIN)
+			digitalWrite(m_statusPin, !digitalRead(m_statusPin));     // set pin to the opposite state
+
+		// send the HTTP request
+		CTBOT_STATS_START(start);
+		bool isWritten = writeRequest(message, text, body, length);
+		CTBOT_STATS_RECORD(m_stats, CTBotStatsWrite, start);
+
+		if (m_statusPin != CTBOT_DISABLE_STATUS_PIN)
+			digitalWrite(m_statusPin, !digitalRead(m_statusPin));     // set pin to the opposite state
+
+		// drop the stale connection, the next connect() will count it as a reconnection
+		if (!isWritten) {
+			m_client->stop();
+			continue;
 		}
 
+		// time to first byte (readHeaders() doesn't wait again for it)
+		CTBOT_STATS_MARK(start);
+		if (!waitForData()) {
+			bool isClosed = !m_client->connected();
+			m_client->stop();
+			// closed without any answer: the server dropped the connection before reading the request
+			if (isClosed)
+				continue;
+			break;
+		}
+		CTBOT_STATS_RECORD(m_stats, CTBotStatsFirstByte, start);
+		CTBOT_STATS_MARK(m_statsMark);
+
+		if (readHeaders()) {
+			recordOutcome(true);
+			return true;
+		}
+
+		// a truncated or invalid answer: the request has been received, don't send it again
+		m_client->stop();
+		break;
 	}
-	else {
-		// try to connect with fixed IP
-		IPAddress telegramServerIP; // (149, 154, 167, 198);
-		telegramServerIP.fromString(TELEGRAM_IP);
-		if (!telegramServer.connect(telegramServerIP, TELEGRAM_PORT)) {
-			serialLog("\nUnable to connect to Telegram server! (use-IP-mode)\n");
-			return "";
+	serialLog("\nNo response from the Telegram server\n");
+	CTBOT_STATS_ERROR(m_stats, CTBotStatsErrorTimeout);
+	recordOutcome(false);
+	return false;
+}
+
+Stream& CTBotSecureConnection::getResponseStream()
+{
+	return m_responseStream;
+}
+
+String CTBotSecureConnection::send(const String& message, const String& text)
+{
+	if (!sendRequest(message, text))
+		return "";
+	return readResponse();
+}
+
+String CTBotSecureConnection::send(const String& message, const Printable& body, size_t length)
+{
+	if (!sendRequest(message, body, length))
+		return "";
+	return readResponse();
+}
+
+String CTBotSecureConnection::readResponse()
+{
+	String response;
+	if (!m_isChunked && (m_contentLeft > 0))
+		response.reserve(m_contentLeft);
+
+	char buffer[READ_BUFFER_SIZE + 1];
+	int32_t length;
+	while ((length = readBody((uint8_t*)buffer, READ_BUFFER_SIZE)) > 0) {
+		buffer[length] = 0x00;
+		response += buffer;
+	}
+	endResponse();
+	if (length < 0) {
+		serialLog("\nUnable to read the response body\n");
+		CTBOT_STATS_ERROR(m_stats, CTBotStatsErrorTimeout);
+		return "";
+	}
+	return response;
+}
+
+int16_t CTBotSecureConnection::getStatusCode() const
+{
+	return m_statusCode;
+}
+
+bool CTBotSecureConnection::writeRequest(const String& message, const String& text, const Printable* body, size_t length)
+{
+	// the message text is URL encoded straight to the connection: no encoded copy is stored
+	if (text.length() != 0) {
+		if ((m_client->print(message) != message.length()) ||
+			(URLEncodeMessage(text, *m_client) != URLEncodedLength(text)))
+			return false;
+		CTBOT_STATS_ADD(m_stats, bytesSent, message.length() + URLEncodedLength(text));
+	}
+
+	// build the rest of the request, so it is sent with a single write
+	String request;
+	request.reserve(message.length() + 128);
+	if (0 == text.length())
+		request = message;
+	request += (String)" HTTP/1.1\r\nHost: " + TELEGRAM_URL + (String)"\r\nConnection: ";
+	request += m_useKeepAlive ? "keep-alive\r\n" : "close\r\n";
+	if (body != NULL)
+		request += (String)"Content-Type: application/json\r\nContent-Length: " + (uint32_t)length + (String)"\r\n";
+	request += "\r\n";
+	CTBOT_STATS_ADD(m_stats, bytesSent, request.length() + length);
+	CTBOT_STATS_ADD(m_stats, requests, 1);
+
+	if (NULL == body)
+		return m_client->print(request) == request.length();
+
+	// the headers and the body are buffered together: the body is serialized
+	// straight to the connection without storing it
+	CTBotBufferedWriter writer(*m_client);
+	writer.print(request);
+	body->printTo(writer);
+	writer.flush();
+	return !writer.isFailed();
+}
+
+bool CTBotSecureConnection::waitForData()
+{
+	uint32_t start = millis();
+	while (!m_client->available()) {
+		if (!m_client->connected() || (millis() - start > m_responseTimeout))
+			return false;
+		delay(1);
+	}
+	return true;
+}
+
+int16_t CTBotSecureConnection::readLine(char* buffer, uint16_t size)
+{
+	uint16_t length = 0;
+	while (waitForData()) {
+		int c = m_client->read();
+		CTBOT_STATS_ADD(m_stats, bytesReceived, 1);
+		if (c == '\n') {
+			// strip the trailing CR
+			if ((length > 0) && (buffer[length - 1] == '\r'))
+				length--;
+			buffer[length] = 0x00;
+			return length;
 		}
-		else
-			serialLog("\nConnected using fixed IP\n");
+		// lines longer than the buffer are truncated
+		if (length < size - 1)
+			buffer[length++] = (char)c;
 	}
+	return -1;
+}
 
-	if (m_statusPin != CTBOT_DISABLE_STATUS_PIN)
-		digitalWrite(m_statusPin, !digitalRead(m_statusPin));     // set pin to the opposite state
+void CTBotSecureConnection::resetResponse()
+{
+	m_statusCode     = 0;
+	m_contentLeft    = -1; // no Content-Length header -> the body ends when the connection is closed
+	m_isChunked      = false;
+	m_isBodyEnded    = false;
+	m_closeRequested = false;
+}
 
-	// send the HTTP request
-	telegramServer.println(message);
+bool CTBotSecureConnection::parseStatusLine(const char* line)
+{
+	if (strncmp(line, "HTTP/1.", 7) != 0) {
+		serialLog("\nInvalid HTTP status line\n");
+		CTBOT_STATS_ERROR(m_stats, CTBotStatsErrorHTTP);
+		return false;
+	}
+	if (line[7] == '0')
+		m_closeRequested = true; // HTTP/1.0 -> no keep alive
+	m_statusCode = atoi(line + 8);
+	if (m_statusCode != 200)
+		CTBOT_STATS_ERROR(m_stats, CTBotStatsErrorHTTP);
+	return true;
+}
 
-	if (m_statusPin != CTBOT_DISABLE_STATUS_PIN)
-		digitalWrite(m_statusPin, !digitalRead(m_statusPin));     // set pin to the opposite state
-
-#if CTBOT_CHECK_JSON == 0
-	return telegramServer.readString();
-#else
-
-	String response("");
-	int curlyCounter = -1; // count the open/closed curly bracket for identify the json
-	bool skipCounter = false; // for filtering curly bracket inside a text message
-	int c;
-
-	while (telegramServer.connected()) {
-		while (telegramServer.available()) {
-			c = telegramServer.read();
-			response += (char)c;
-			if (c == '\\') {
-				// escape character -> read next and skip
-				c = telegramServer.read();
-				response += (char)c;
-				continue;
+void CTBotSecureConnection::parseHeader(const char* line)
+{
+	if (0 == strncasecmp(line, "Content-Length:", 15))
+		m_contentLeft = atol(line + 15);
+	else if (0 == strncasecmp(line, "Transfer-Encoding:", 18))
+		m_isChunked = (strstr(line + 18, "chunked") != NULL);
+	else if (0 == strncasecmp(line, "Connection:", 11))
+		m_closeRequested = m_closeRequested || (strstr(line + 11, "close") != NULL);
+}
+
+bool CTBotSecureConnection::readHeaders()
+{
+	char line[CTBOT_HTTP_LINE_SIZE];
+	int16_t length;
+
+	resetResponse();
+
+	// status line, i.e. HTTP/1.1 200 OK
+	if (readLine(line, sizeof(line)) < 0)
+		return false;
+	if (!parseStatusLine(line))
+		return false;
+
+	// headers, until an empty line
+	while ((length = readLine(line, sizeof(line))) > 0)
+		parseHeader(line);
+	if (length < 0)
+		return false;
+
+	// the size of the first chunk is still unknown
+	if (m_isChunked)
+		m_contentLeft = 0;
+	return true;
+}
+
+int32_t CTBotSecureConnection::readBody(uint8_t* buffer, uint16_t size)
+{
+	if (m_isBodyEnded)
+		return 0;
+
+	if (m_isChunked && (0 == m_contentLeft)) {
+		// chunk header: <size in hex>[;extensions]. Every chunk but the first is preceded by a CRLF
+		char line[CTBOT_HTTP_LINE_SIZE];
+		int16_t length = readLine(line, sizeof(line));
+		if (0 == length)
+			length = readLine(line, sizeof(line));
+		if (length <= 0)
+			return -1;
+		m_contentLeft = strtol(line, NULL, 16);
+		if (0 == m_contentLeft) {
+			// last chunk: skip the (optional) trailer
+			while ((length = readLine(line, sizeof(line))) > 0);
+			m_isBodyEnded = true;
+			return (length < 0) ? -1 : 0;
+		}
+	}
+
+	if (0 == m_contentLeft) {
+		m_isBodyEnded = true;
+		return 0;
+	}
+
+	if (!waitForData()) {
+		if (m_contentLeft < 0) {
+			// body delimited by the connection close
+			m_isBodyEnded = true;
+			return 0;
+		}
+		return -1;
+	}
+
+	int32_t toRead = m_client->available();
+	if (toRead > size)
+		toRead = size;
+	if ((m_contentLeft > 0) && (toRead > m_contentLeft))
+		toRead = m_contentLeft;
+
+	int32_t length = m_client->read(buffer, toRead);
+	if (length <= 0)
+		return -1;
+	CTBOT_STATS_ADD(m_stats, bytesReceived, length);
+	if (m_contentLeft > 0)
+		m_contentLeft -= length;
+	return length;
+}
+
+void CTBotSecureConnection::endResponse()
+{
+	CTBOT_STATS_RECORD(m_stats, CTBotStatsRead, m_statsMark);
+
+	if (m_useKeepAlive && !m_closeRequested) {
+		// discard the unread part of the body: its length is known, so there is no need to wait for a timeout
+		uint8_t buffer[CTBOT_HTTP_LINE_SIZE];
+		int32_t length;
+		while ((length = readBody(buffer, sizeof(buffer))) > 0);
+		if (0 == length)
+			return;
+	}
+	m_client->stop();
+}
+
+CTBotResponseStream::CTBotResponseStream(CTBotSecureConnection& connection) : m_connection(connection)
+{
+	// read() already waits for the data (up to the connection response timeout)
+	setTimeout(0);
+}
+
+void CTBotResponseStream::reset()
+{
+	m_length = 0;
+	m_position = 0;
+}
+
+bool CTBotResponseStream::fill()
+{
+	if (m_position < m_length)
+		return true;
+	reset();
+	int32_t length = m_connection.readBody(m_buffer, sizeof(m_buffer));
+	if (length <= 0)
+		return false;
+	m_length = length;
+	return true;
+}
+
+int CTBotResponseStream::available()
+{
+	if (m_position < m_length)
+		return m_length - m_position;
+	if (m_connection.m_isBodyEnded)
+		return 0;
+	return m_connection.m_client->available();
+}
+
+int CTBotResponseStream::read()
+{
+	if (!fill())
+		return -1;
+	return m_buffer[m_position++];
+}
+
+int CTBotResponseStream::peek()
+{
+	if (!fill())
+		return -1;
+	return m_buffer[m_position];
+}
+
+size_t CTBotResponseStream::write(uint8_t)
+{
+	// read-only stream
+	return 0;
+}
+
+bool CTBotSecureConnection::isBusy() const
+{
+	return (m_requestState != CTBotRequestIdle) &&
+		(m_requestState != CTBotRequestDone) &&
+		(m_requestState != CTBotRequestError);
+}
+
+bool CTBotSecureConnection::beginRequest(const String& message, uint32_t timeout, const String& body)
+{
+	if (isBusy())
+		return false;
+
+	m_asyncRequest  = message;
+	m_asyncBody     = body;
+	m_asyncResponse = "";
+	m_asyncTimeout  = timeout;
+	m_isAsyncRetry  = m_useKeepAlive && m_isLinkOpen && m_client->connected();
+	m_requestState  = CTBotRequestConnecting;
+	return true;
+}
+
+CTBotRequestState CTBotSecureConnection::poll(uint32_t budget)
+{
+	uint32_t start = millis();
+	bool isProgressing = true;
+
+	while (isProgressing && (millis() - start <= budget)) {
+		switch (m_requestState) {
+		case CTBotRequestConnecting:
+			// blocking step (skipped if the kept alive connection is still open).
+			// No connection attempt at all while the circuit is open
+			if (!checkCircuit())
+				completeRequest(false);
+			else if (connect())
+				m_requestState = CTBotRequestWriting;
+			else {
+				recordOutcome(false);
+				completeRequest(false);
+			}
+			break;
+
+		case CTBotRequestWriting: {
+			if (m_statusPin != CTBOT_DISABLE_STATUS_PIN)
+				digitalWrite(m_statusPin, !digitalRead(m_statusPin));     // set pin to the opposite state
+			CTBOT_STATS_MARK(m_statsMark);
+			bool isWritten;
+			if (m_asyncBody.length() != 0) {
+				CTBotStringBody body(m_asyncBody);
+				isWritten = writeRequest(m_asyncRequest, "", &body, m_asyncBody.length());
 			}
-			if (c == '"')
-				skipCounter = !skipCounter;
-			if (!skipCounter) {
-				if (c == '{') {
-					if (curlyCounter == -1)
-						curlyCounter = 1;
-					else
-						curlyCounter++;
-				}
-				else if (c == '}')
-					curlyCounter--;
-				if (curlyCounter == 0) {
-
-					// JSON ended, close connection and return JSON
-					telegramServer.flush();
-					telegramServer.stop();
-					return response;
-				}
+			else
+				isWritten = writeRequest(m_asyncRequest);
+			CTBOT_STATS_RECORD(m_stats, CTBotStatsWrite, m_statsMark);
+			CTBOT_STATS_MARK(m_statsMark);
+			if (m_statusPin != CTBOT_DISABLE_STATUS_PIN)
+				digitalWrite(m_statusPin, !digitalRead(m_statusPin));     // set pin to the opposite state
+
+			// kept until the server answers, in case it must be sent again
+			if (!m_isAsyncRetry) {
+				m_asyncRequest = "";
+				m_asyncBody    = "";
 			}
+			m_asyncStart       = millis();
+			m_lineLength       = 0;
+			m_isStatusLineRead = false;
+			m_isChunkTrailer   = false;
+			resetResponse();
+			m_requestState     = CTBotRequestReadingHeaders;
+			// the write failed: drop the connection, checkTimeout() retries or fails the request
+			if (!isWritten)
+				m_client->stop();
+			break;
+		}
+
+		case CTBotRequestReadingHeaders:
+			isProgressing = pollHeaders();
+			break;
+
+		case CTBotRequestReadingBody:
+			isProgressing = pollBody();
+			break;
+
+		default:
+			// idle, done or error: nothing to do
+			isProgressing = false;
+			break;
 		}
 	}
+	return m_requestState;
+}
+
+bool CTBotSecureConnection::pollLine()
+{
+	while (m_client->available()) {
+		int c = m_client->read();
+		CTBOT_STATS_ADD(m_stats, bytesReceived, 1);
+		if (c != '\n') {
+			// lines longer than the buffer are truncated
+			if (m_lineLength < sizeof(m_lineBuffer) - 1)
+				m_lineBuffer[m_lineLength++] = (char)c;
+			continue;
+		}
 
-	// timeout, no JSON to parse
-	telegramServer.flush();
-	telegramServer.stop();
-	return "";
+		// strip the trailing CR
+		if ((m_lineLength > 0) && (m_lineBuffer[m_lineLength - 1] == '\r'))
+			m_lineLength--;
+		m_lineBuffer[m_lineLength] = 0x00;
+		return true;
+	}
+	return false;
+}
+
+bool CTBotSecureConnection::pollHeaders()
+{
+#if CTBOT_ENABLE_STATS > 0
+	if (!m_isStatusLineRead && (0 == m_lineLength) && m_client->available()) {
+		CTBOT_STATS_RECORD(m_stats, CTBotStatsFirstByte, m_statsMark);
+		CTBOT_STATS_MARK(m_statsMark);
+	}
 #endif
-}
\ No newline at end of file
+	while (pollLine()) {
+		if (!m_isStatusLineRead) {
+			if (!parseStatusLine(m_lineBuffer)) {
+				completeRequest(false);
+				return true;
+			}
+			// the server answered: the request is never sent again
+			recordOutcome(true);
+			m_isStatusLineRead = true;
+			m_isAsyncRetry     = false;
+			m_asyncRequest     = "";
+			m_asyncBody        = "";
+		}
+		else if (0 == m_lineLength) {
+			// empty line: headers ended
+			if (m_isChunked)
+				m_contentLeft = 0;
+			else if (m_contentLeft > 0)
+				m_asyncResponse.reserve(m_contentLeft);
+			m_requestState = CTBotRequestReadingBody;
+			return true;
+		}
+		else
+			parseHeader(m_lineBuffer);
+		m_lineLength = 0;
+	}
+	return checkTimeout();
+}
+
+bool CTBotSecureConnection::pollBody()
+{
+	if (!m_isChunked && (0 == m_contentLeft)) {
+		completeRequest(true);
+		return true;
+	}
+
+	// chunk header: <size in hex>[;extensions], preceded by a CRLF (but the first one).
+	// It is parsed as its bytes arrive, as the headers: readBody() would wait for them
+	if (m_isChunked && (0 == m_contentLeft)) {
+		if (!pollLine())
+			return checkTimeout();
+		bool isEmpty = (0 == m_lineLength);
+		m_lineLength = 0;
+		if (m_isChunkTrailer) {
+			// the (optional) trailer ends with an empty line
+			if (isEmpty) {
+				m_isBodyEnded = true;
+				completeRequest(true);
+			}
+		}
+		else if (!isEmpty) {
+			m_contentLeft = strtol(m_lineBuffer, NULL, 16);
+			// last chunk
+			if (0 == m_contentLeft)
+				m_isChunkTrailer = true;
+		}
+		return true;
+	}
+
+	if (!m_client->available()) {
+		if ((m_contentLeft < 0) && !m_client->connected()) {
+			// body delimited by the connection close
+			completeRequest(true);
+			return true;
+		}
+		return checkTimeout();
+	}
+
+	char buffer[READ_BUFFER_SIZE + 1];
+	int32_t length = readBody((uint8_t*)buffer, READ_BUFFER_SIZE);
+	if (length <= 0) {
+		completeRequest(0 == length);
+		return true;
+	}
+	buffer[length] = 0x00;
+	m_asyncResponse += buffer;
+	return true;
+}
+
+bool CTBotSecureConnection::checkTimeout()
+{
+	bool isConnected = m_client->connected();
+	if (isConnected && (millis() - m_asyncStart <= m_asyncTimeout))
+		return false;
+
+	// as sendHTTPRequest(): a kept alive connection closed (or not writable) without any answer, the server
+	// can't have handled the request. It is sent again (once) with a new connection. A timeout is never retried
+	if (!isConnected && m_isAsyncRetry && !m_isStatusLineRead && (0 == m_lineLength)) {
+		m_isAsyncRetry = false;
+		// drop the stale connection, the next connect() will count it as a reconnection
+		m_client->stop();
+		m_requestState = CTBotRequestConnecting;
+		return true;
+	}
+
+	serialLog("\nAsynchronous request: timeout or connection lost\n");
+	CTBOT_STATS_ERROR(m_stats, CTBotStatsErrorTimeout);
+	if (!m_isStatusLineRead)
+		recordOutcome(false);
+	completeRequest(false);
+	return true;
+}
+
+void CTBotSecureConnection::completeRequest(bool result)
+{
+	if (result) {
+		endResponse();
+		m_requestState = CTBotRequestDone;
+	}
+	else {
+		// drop the connection, the next connect() will count it as a reconnection
+		m_client->stop();
+		m_asyncRequest  = "";
+		m_asyncBody     = "";
+		m_asyncResponse = "";
+		m_requestState  = CTBotRequestError;
+	}
+}
+
+String CTBotSecureConnection::takeResponse()
+{
+	String response(std::move(m_asyncResponse));
+	m_asyncResponse = "";
+	m_requestState = CTBotRequestIdle;
+	return response;
+}
@@ -3,16 +3,69 @@
 #define CTBOTSECURECONNECTION
 
 #include <Arduino.h>
+#include <WiFiClientSecure.h>
 #include "CTBotDefines.h"
+#include "CTBotStats.h"
+
+class CTBotSecureConnection;
+
+// the states of an asynchronous request
+enum CTBotRequestState {
+	CTBotRequestIdle           = 0, // no request in progress
+	CTBotRequestConnecting     = 1, // DNS, TCP connection and TLS handshake
+	CTBotRequestWriting        = 2, // sending the request
+	CTBotRequestReadingHeaders = 3, // reading the response status line and headers
+	CTBotRequestReadingBody    = 4, // reading the response body
+	CTBotRequestDone           = 5, // the response is ready
+	CTBotRequestError          = 6  // the request failed
+};
+
+// the states of the circuit breaker that protects the connection with the Telegram server
+enum CTBotCircuitState {
+	CTBotCircuitClosed   = 0, // the requests are sent
+	CTBotCircuitOpen     = 1, // too many failures: the requests fail fast until the backoff expires
+	CTBotCircuitHalfOpen = 2  // backoff expired: the next request is a probe that closes or reopens the circuit
+};
+
+// read-only Stream over the body of the current response: a JSON document can be
+// deserialized straight from the connection, without storing the whole response in a String
+class CTBotResponseStream : public Stream
+{
+public:
+	explicit CTBotResponseStream(CTBotSecureConnection& connection);
+
+	// discard the buffered data of the previous response
+	void reset(void);
+
+	int    available(void) override;
+	int    read(void) override;
+	int    peek(void) override;
+	size_t write(uint8_t) override;
+
+private:
+	CTBotSecureConnection& m_connection;
+	uint8_t  m_buffer[CTBOT_STREAM_BUFFER_SIZE];
+	uint16_t m_length{ 0 };
+	uint16_t m_position{ 0 };
+
+	// refill the buffer with a bulk read of the response body
+	// returns
+	//   true if some data is available
+	bool fill(void);
+};
 
 class CTBotSecureConnection
 {
+	friend class CTBotResponseStream;
+
 public:
 	CTBotSecureConnection();
 
-	// use the URL style address "api.telegram.org" or the fixed IP address "149.154.167.198"
-	// for all communication with the telegram server. When changing to true a test 
-	// connection is made using the URL. If no connection is made useDNS falls back to false. 
+	// resolve the URL style address "api.telegram.org" or use only the fixed IP address "149.154.167.220"
+	// (and the ones added with addEndpoint()) for all communication with the telegram server.
+	// The resolved address is cached for CTBOT_DNS_CACHE_TTL milliseconds and ranked with the
+	// other endpoints: if the DNS lookup fails, the cached or the fixed addresses are used.
+	// The resolved endpoint is connected by name (the TLS handshake sends the SNI), the other ones by IP.
 	// Default value is false
 	// params
 	//   value: true  -> use URL style address
@@ -21,6 +74,15 @@ public:
 	//	 returns true when the new value was successfully applied
 	bool useDNS(bool value);
 
+	// add an address of the Telegram server to the endpoint list. Every connection tries the
+	// fastest healthy endpoint first (the connect time is measured); an endpoint that fails to
+	// connect is skipped for CTBOT_ENDPOINT_BACKOFF milliseconds, doubled at every failure
+	// params
+	//   ip: the IP address, i.e. "149.154.167.220"
+	// returns
+	//   false if the address is not valid
+	bool addEndpoint(const String& ip);
+
 	// set the new Telegram API server fingerprint overwriting the default one.
 	// It can be obtained by this service: https://www.grc.com/fingerprints.htm
 	// quering api.telegram.org
@@ -35,13 +97,351 @@ public:
 	//   pin: the pin used for visual notification
 	void setStatusPin(int8_t pin);
 
-	String send(const String& message) const;
+	// keep the connection with the Telegram server open between requests (HTTP/1.1 keep-alive).
+	// The TLS handshake is done only once and repeated only when the link drops.
+	// Default value is false (a new connection for every request)
+	// params
+	//   value: true  -> reuse the same connection for all the requests
+	//          false -> open a new connection for every request
+	void useKeepAlive(bool value);
+
+	// get how many TLS handshakes (connections) were made with the Telegram server
+	// returns
+	//   the number of handshakes
+	uint32_t getHandshakeCount(void) const;
+
+	// get how many times a kept alive connection was dropped and has been re-established
+	// returns
+	//   the number of reconnections
+	uint32_t getReconnectCount(void) const;
+
+	// get how many TLS handshakes resumed the session of the previous connection (abbreviated
+	// handshake: no key exchange and no certificate validation). Only for ESP8266
+	// (see CTBOT_TLS_SESSION_RESUMPTION), always zero on ESP32
+	// returns
+	//   the number of resumed handshakes
+	uint32_t getResumedHandshakeCount(void) const;
+
+	// set how long to wait for the Telegram server response
+	// Default value is CTBOT_RESPONSE_TIMEOUT
+	// params
+	//   timeout: the timeout, in milliseconds
+	void setResponseTimeout(uint32_t timeout);
+
+	// replace the built-in TLS client with a custom transport, i.e. a client connected
+	// to a local fake Telegram server for testing or benchmarking. The custom transport
+	// is used as is: no TLS configuration is applied (fingerprint, buffer sizes)
+	// params
+	//   client: the transport to use, NULL -> restore the built-in TLS client
+	void setTransport(Client* client);
+
+	// close the connection with the Telegram server (if any)
+	void disconnect(void);
+
+	// get the state of the circuit breaker. After CTBOT_CIRCUIT_THRESHOLD consecutive failed requests
+	// the circuit opens: the requests fail immediately (no connection attempt) for CTBOT_CIRCUIT_BACKOFF
+	// milliseconds, with jitter, then a probe request is sent. Every failed probe doubles the delay
+	// (up to CTBOT_CIRCUIT_MAX_BACKOFF), a successful one closes the circuit
+	// returns
+	//   the state of the circuit breaker
+	CTBotCircuitState getCircuitState(void) const;
+
+	// get how long the circuit stays open
+	// returns
+	//   the milliseconds before the next probe request, zero if the requests are sent
+	uint32_t getCircuitRetryDelay(void) const;
+
+	// close the circuit breaker: the next request is sent immediately (i.e. the WiFi has been reconnected)
+	void resetCircuit(void);
+
+	// send a request to the Telegram server and read the response headers. The response body
+	// must be read with the stream returned by getResponseStream(), then endResponse() must be called
+	// params
+	//   message: the request to send, i.e. GET /bot<token>/sendMessage?chat_id=123&text=
+	//   text   : (optional) appended to the request URL encoded, straight to the connection
+	// returns
+	//   true if no error occurred
+	bool sendRequest(const String& message, const String& text = "");
+
+	// send a POST request with a JSON body (Content-Type: application/json) and read the response
+	// headers. The body is serialized straight to the connection: no copy of the body is stored.
+	// The response body must be read as with sendRequest()
+	// params
+	//   message: the request line, i.e. POST /bot<token>/sendMessage
+	//   body   : the request body
+	//   length : the body length (Content-Length)
+	// returns
+	//   true if no error occurred
+	bool sendRequest(const String& message, const Printable& body, size_t length);
+
+	// get the stream of the current response body
+	// returns
+	//   the response body stream
+	Stream& getResponseStream(void);
+
+	// complete the current response: with a kept alive connection the unread body
+	// is discarded, otherwise the connection is closed
+	void endResponse(void);
+
+	// send a request to the Telegram server and read the whole response
+	// params
+	//   message: the request to send, i.e. GET /bot<token>/getMe
+	//   text   : (optional) appended to the request URL encoded, straight to the connection
+	// returns
+	//   an empty string if error
+	//   a string containing the Telegram JSON response
+	String send(const String& message, const String& text = "");
+
+	// send a POST request with a JSON body and read the whole response
+	// params
+	//   message: the request line, i.e. POST /bot<token>/sendMessage
+	//   body   : the request body
+	//   length : the body length (Content-Length)
+	// returns
+	//   an empty string if error
+	//   a string containing the Telegram JSON response
+	String send(const String& message, const Printable& body, size_t length);
+
+	// start an asynchronous request: this member function returns immediately,
+	// the request is carried on by poll()
+	// params
+	//   message: the request to send, i.e. GET /bot<token>/getMe
+	//   timeout: how long to wait for the response, in milliseconds
+	//   body   : (optional) the JSON body of a POST request
+	// returns
+	//   false if another request is in progress
+	bool beginRequest(const String& message, uint32_t timeout, const String& body = "");
+
+	// advance the asynchronous request. The connection to the server (TCP and TLS handshake)
+	// can't be done asynchronously and blocks until connected: with the keep alive mode
+	// enabled it is done only when the link drops. All the other steps never wait for data
+	// params
+	//   budget: the max time to spend, in milliseconds
+	// returns
+	//   the state of the request
+	CTBotRequestState poll(uint32_t budget);
+
+	// get the response of a completed asynchronous request. The connection returns idle
+	// returns
+	//   the response body, an empty string if the request failed
+	String takeResponse(void);
+
+	// check if a request is in progress
+	// returns
+	//   true if the connection is busy
+	bool isBusy(void) const;
+
+#if CTBOT_ENABLE_STATS > 0
+	// get the statistics of the requests sent to the Telegram server
+	// returns
+	//   the statistics
+	CTBotStats& getStats(void);
+	const CTBotStats& getStats(void) const;
+#endif
+
+	// get the HTTP status code of the last response
+	// returns
+	//   the HTTP status code (i.e. 200), zero if no response was received
+	int16_t getStatusCode(void) const;
 
 private:
+#if defined(ARDUINO_ARCH_ESP8266) && CTBOT_USE_FINGERPRINT == 1
+	BearSSL::WiFiClientSecure m_telegramServer;
+#else
+	WiFiClientSecure m_telegramServer;
+#endif
+	Client*  m_client{ &m_telegramServer }; // the transport in use
+	bool     m_useKeepAlive{ false }; // a new connection for every request by default
+	bool     m_isLinkOpen{ false };   // true if a kept alive connection should be still open
+	uint32_t m_handshakes{ 0 };
+	uint32_t m_reconnects{ 0 };
+	uint32_t m_resumedHandshakes{ 0 };
+#if defined(ARDUINO_ARCH_ESP8266) && CTBOT_TLS_SESSION_RESUMPTION > 0
+	BearSSL::Session m_session; // the TLS session of the last connection, offered to the server by the next handshake
+#endif
+	uint32_t m_responseTimeout{ CTBOT_RESPONSE_TIMEOUT };
+
+	// HTTP response framing
+	int16_t  m_statusCode{ 0 };        // HTTP status code of the last response
+	int32_t  m_contentLeft{ 0 };       // body bytes still to read (of the current chunk if chunked). -1 -> until the connection is closed
+	bool     m_isChunked{ false };     // the body uses the chunked transfer encoding
+	bool     m_isBodyEnded{ true };    // the whole body has been read
+	bool     m_closeRequested{ false }; // the server will close the connection after the response
+	CTBotResponseStream m_responseStream{ *this };
+
+	// asynchronous request
+	CTBotRequestState m_requestState{ CTBotRequestIdle };
+	String   m_asyncRequest;
+	String   m_asyncBody;
+	String   m_asyncResponse;
+	uint32_t m_asyncStart{ 0 };   // when the request was sent (for the timeout)
+	uint32_t m_asyncTimeout{ 0 };
+	char     m_lineBuffer[CTBOT_HTTP_LINE_SIZE];
+	uint8_t  m_lineLength{ 0 };
+	bool     m_isStatusLineRead{ false };
+	bool     m_isChunkTrailer{ false }; // the last chunk has been read: the trailer follows
+	bool     m_isAsyncRetry{ false };   // sent on a kept alive connection: if stale, the request is sent again (once)
+
+#if CTBOT_ENABLE_STATS > 0
+	CTBotStats m_stats;
+	uint32_t   m_statsMark{ 0 }; // start of the current response phase (micros)
+#endif
+
+	// an address of the Telegram server, with its health
+	struct CTBotEndpoint {
+		IPAddress ip;
+		uint32_t  expires;    // resolved address: when a new DNS lookup is due (millis)
+		uint32_t  retryAfter; // when an endpoint that failed can be tried again (millis)
+		uint16_t  latency;    // smoothed connect time (TCP and TLS handshake), in milliseconds. Zero -> not measured yet
+		uint8_t   failures;   // consecutive connect failures
+		bool      isResolved; // resolved with a DNS lookup
+	};
+
 	bool    m_useDNS{ false }; // use static ip by default
+	CTBotEndpoint m_endpoints[CTBOT_ENDPOINTS_SIZE]; // the fixed IP is always the first one
+	uint8_t  m_endpointCount{ 0 };
+	uint32_t m_nextLookup{ 0 }; // a failed DNS lookup is not repeated before this time (millis)
+
+	// circuit breaker
+	CTBotCircuitState m_circuitState{ CTBotCircuitClosed };
+	uint8_t  m_circuitFailures{ 0 }; // consecutive failed requests
+	uint8_t  m_circuitTrips{ 0 };    // consecutive openings of the circuit (failed probes), for the backoff
+	uint32_t m_circuitRetryAt{ 0 };  // when the probe request can be sent (millis)
+	bool     m_isWifiDown{ false };  // the WiFi was not connected at the last request
 	int8_t  m_statusPin{ CTBOT_DISABLE_STATUS_PIN }; // status pin is disabled by default
 	// get fingerprints from https://www.grc.com/fingerprints.htm
 	uint8_t m_fingerprint[20]{ 0xF2, 0xAD, 0x29, 0x9C, 0x34, 0x48, 0xDD, 0x8D, 0xF4, 0xCF, 0x52, 0x32, 0xF6, 0x57, 0x33, 0x68, 0x2E, 0x81, 0xC1, 0x90 }; // use this preconfigured fingerprrint by default
+
+	// connect to the Telegram server. If the keep alive mode is enabled and the
+	// connection is still open, nothing is done
+	// returns
+	//   true if no error occurred
+	bool connect(void);
+
+	// check if a request can be sent: the circuit is not open and the WiFi (if used) is connected.
+	// When the backoff expires the circuit becomes half open and the request is the probe
+	// returns
+	//   false if the request must fail fast
+	bool checkCircuit(void);
+
+	// update the circuit breaker with the outcome of a request (the Telegram server answered or not)
+	// params
+	//   isReachable: true if the server answered
+	void recordOutcome(bool isReachable);
+
+	// refresh the resolved address of the Telegram server, if the cached one has expired (use DNS mode)
+	void resolveEndpoints(void);
+
+	// add an endpoint or refresh an existing one. When the list is full, the least healthy endpoint
+	// (the fixed IP excluded) is replaced
+	// params
+	//   ip        : the address
+	//   isResolved: true if resolved with a DNS lookup
+	// returns
+	//   the endpoint
+	CTBotEndpoint& storeEndpoint(const IPAddress& ip, bool isResolved);
+
+	// get the next endpoint to try: the healthy ones (no failures) first, then the ones whose backoff
+	// is over. Inside each group, the fastest one (the not measured ones first)
+	// params
+	//   tried: bitmask of the endpoints already tried
+	// returns
+	//   the index of the endpoint, -1 if all the endpoints are tried or backing off
+	int8_t selectEndpoint(uint8_t tried) const;
+
+	// connect to an endpoint and update its health
+	// params
+	//   index: the index of the endpoint
+	// returns
+	//   true if connected
+	bool connectEndpoint(uint8_t index);
+
+	// send a request and read the response headers, with a new connection if a kept alive one was dropped
+	// params
+	//   message: the request, i.e. GET /bot<token>/getMe
+	//   text   : appended to the request URL encoded (can be empty)
+	//   body   : the JSON body, NULL if none
+	//   length : the body length
+	// returns
+	//   true if no error occurred
+	bool sendHTTPRequest(const String& message, const String& text, const Printable* body, size_t length);
+
+	// read the whole body of the current response
+	// returns
+	//   the response body, an empty string if error
+	String readResponse(void);
+
+	// send the HTTP/1.1 request line, headers and body
+	// params
+	//   message: the request, i.e. GET /bot<token>/getMe
+	//   text   : (optional) appended to the request URL encoded
+	//   body   : (optional) the JSON body
+	//   length : (optional) the body length
+	// returns
+	//   false if the request could not be written (i.e. the connection has been closed)
+	bool writeRequest(const String& message, const String& text = "", const Printable* body = NULL, size_t length = 0);
+
+	// wait until some data is available or the timeout/disconnection occurs
+	// returns
+	//   true if some data is available
+	bool waitForData(void);
+
+	// read a CRLF terminated line (status line, header or chunk size)
+	// params
+	//   buffer: where to store the line (CRLF stripped, zero terminated)
+	//   size  : the size of the buffer. Longer lines are truncated
+	// returns
+	//   the length of the line, -1 if timeout
+	int16_t readLine(char* buffer, uint16_t size);
+
+	// parse the status line and the headers of the response
+	// returns
+	//   true if no error occurred
+	bool readHeaders(void);
+
+	// reset the response framing, before reading a new response
+	void resetResponse(void);
+
+	// parse the response status line, i.e. HTTP/1.1 200 OK
+	// params
+	//   line: the status line
+	// returns
+	//   true if no error occurred
+	bool parseStatusLine(const char* line);
+
+	// parse a response header (only the ones needed by the framing are handled)
+	// params
+	//   line: the header line
+	void parseHeader(const char* line);
+
+	// read a CRLF terminated line into m_lineBuffer, only with the bytes already received
+	// returns
+	//   true if the whole line has been read, false if more data is needed
+	bool pollLine(void);
+
+	// asynchronous request steps: read the headers/the body without waiting for data
+	// returns
+	//   true if the request state has changed or some data has been read
+	bool pollHeaders(void);
+	bool pollBody(void);
+
+	// check the timeout of the asynchronous request
+	// returns
+	//   true if the request failed for timeout or disconnection
+	bool checkTimeout(void);
+
+	// terminate the asynchronous request
+	// params
+	//   result: true -> the response is ready, false -> the request failed
+	void completeRequest(bool result);
+
+	// read a block of the response body, decoding the chunked transfer encoding
+	// params
+	//   buffer: where to store the data
+	//   size  : the size of the buffer
+	// returns
+	//   the number of bytes read, zero if the body is ended, -1 if error
+	int32_t readBody(uint8_t* buffer, uint16_t size);
 };
 
 #endif
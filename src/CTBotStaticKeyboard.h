@@ -0,0 +1,62 @@
+#pragma once
+#ifndef CTBOT_STATIC_KEYBOARD
+#define CTBOT_STATIC_KEYBOARD
+
+// Static keyboards: the keyboard JSON is built by the preprocessor as a string literal, so
+// it can be stored in flash and sent with CTBot::sendMessage() without any heap allocation
+// or serialization. Use them for the menus that never change; CTBotInlineKeyboard and
+// CTBotReplyKeyboard are still needed for the keyboards built at runtime.
+// The labels and the data are copied as they are in the JSON: quotes and backslashes
+// must be escaped (i.e. "say \\\"hi\\\"").
+// Up to 8 buttons per row and 8 rows per keyboard.
+//
+// Example:
+//   static const char lightKeyboard[] PROGMEM = CTBOT_STATIC_INLINE_KEYBOARD(
+//       CTBOT_ROW(CTBOT_QUERY_BUTTON("LIGHT ON", "lightOn"), CTBOT_QUERY_BUTTON("LIGHT OFF", "lightOff")),
+//       CTBOT_ROW(CTBOT_URL_BUTTON("see docs", "https://github.com/shurillu/CTBot")));
+//   ...
+//   myBot.sendMessage(msg.sender.id, "Light control", FPSTR(lightKeyboard));
+
+// join up to 8 string literals with a comma
+#define CTBOT_JOIN_1(a) a
+#define CTBOT_JOIN_2(a, ...) a "," CTBOT_JOIN_1(__VA_ARGS__)
+#define CTBOT_JOIN_3(a, ...) a "," CTBOT_JOIN_2(__VA_ARGS__)
+#define CTBOT_JOIN_4(a, ...) a "," CTBOT_JOIN_3(__VA_ARGS__)
+#define CTBOT_JOIN_5(a, ...) a "," CTBOT_JOIN_4(__VA_ARGS__)
+#define CTBOT_JOIN_6(a, ...) a "," CTBOT_JOIN_5(__VA_ARGS__)
+#define CTBOT_JOIN_7(a, ...) a "," CTBOT_JOIN_6(__VA_ARGS__)
+#define CTBOT_JOIN_8(a, ...) a "," CTBOT_JOIN_7(__VA_ARGS__)
+#define CTBOT_JOIN_SELECT(_1, _2, _3, _4, _5, _6, _7, _8, NAME, ...) NAME
+#define CTBOT_JOIN(...) CTBOT_JOIN_SELECT(__VA_ARGS__, CTBOT_JOIN_8, CTBOT_JOIN_7, CTBOT_JOIN_6, CTBOT_JOIN_5, \
+	CTBOT_JOIN_4, CTBOT_JOIN_3, CTBOT_JOIN_2, CTBOT_JOIN_1, unused)(__VA_ARGS__)
+
+// a row of buttons
+#define CTBOT_ROW(...) "[" CTBOT_JOIN(__VA_ARGS__) "]"
+
+// inline keyboard buttons
+//   text: the text displayed as button label
+//   data: the callback query data
+//   url : the URL opened by the button
+#define CTBOT_QUERY_BUTTON(text, data) "{\"text\":\"" text "\",\"callback_data\":\"" data "\"}"
+#define CTBOT_URL_BUTTON(text, url)    "{\"text\":\"" text "\",\"url\":\"" url "\"}"
+
+// an inline keyboard made of rows (see CTBOT_ROW)
+#define CTBOT_STATIC_INLINE_KEYBOARD(...) "{\"inline_keyboard\":[" CTBOT_JOIN(__VA_ARGS__) "]}"
+
+// reply keyboard buttons
+//   text: the text displayed as button label (and sent when pressed)
+#define CTBOT_TEXT_BUTTON(text)     "{\"text\":\"" text "\"}"
+#define CTBOT_CONTACT_BUTTON(text)  "{\"text\":\"" text "\",\"request_contact\":true}"
+#define CTBOT_LOCATION_BUTTON(text) "{\"text\":\"" text "\",\"request_location\":true}"
+
+// reply keyboard options, to be used with CTBOT_STATIC_REPLY_KEYBOARD_OPTIONS. They can be concatenated
+#define CTBOT_KEYBOARD_RESIZE    ",\"resize_keyboard\":true"
+#define CTBOT_KEYBOARD_ONE_TIME  ",\"one_time_keyboard\":true"
+#define CTBOT_KEYBOARD_SELECTIVE ",\"selective\":true"
+
+// a reply keyboard made of rows (see CTBOT_ROW)
+//   options: the reply keyboard options, i.e. CTBOT_KEYBOARD_RESIZE CTBOT_KEYBOARD_ONE_TIME
+#define CTBOT_STATIC_REPLY_KEYBOARD(...) "{\"keyboard\":[" CTBOT_JOIN(__VA_ARGS__) "]}"
+#define CTBOT_STATIC_REPLY_KEYBOARD_OPTIONS(options, ...) "{\"keyboard\":[" CTBOT_JOIN(__VA_ARGS__) "]" options "}"
+
+#endif
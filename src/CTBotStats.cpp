@@ -0,0 +1,42 @@
+#include "CTBotStats.h"
+
+#if CTBOT_ENABLE_STATS > 0
+void CTBotStats::reset()
+{
+	for (uint8_t i = 0; i < CTBotStatsPhaseCount; i++) {
+		phases[i].count = 0;
+		phases[i].min   = UINT32_MAX;
+		phases[i].max   = 0;
+		phases[i].total = 0;
+		for (uint8_t j = 0; j < CTBOT_STATS_HISTOGRAM_SIZE; j++)
+			phases[i].histogram[j] = 0;
+	}
+	for (uint8_t i = 0; i < CTBotStatsErrorCount; i++)
+		errors[i] = 0;
+	requests      = 0;
+	bytesSent     = 0;
+	bytesReceived = 0;
+	heapLowWater  = ESP.getFreeHeap();
+}
+
+void CTBotStats::record(CTBotStatsPhase phase, uint32_t elapsed)
+{
+	CTBotStatsTiming& timing = phases[phase];
+	timing.count++;
+	timing.total += elapsed;
+	if (elapsed < timing.min)
+		timing.min = elapsed;
+	if (elapsed > timing.max)
+		timing.max = elapsed;
+
+	// the first bucket ends at 256us, every next one is 4 times longer
+	uint8_t bucket = 0;
+	for (uint32_t limit = 256; (elapsed >= limit) && (bucket < CTBOT_STATS_HISTOGRAM_SIZE - 1); limit <<= 2)
+		bucket++;
+	timing.histogram[bucket]++;
+
+	uint32_t heap = ESP.getFreeHeap();
+	if (heap < heapLowWater)
+		heapLowWater = heap;
+}
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+#ifndef CTBOT_STATS
+#define CTBOT_STATS
+
+#include <Arduino.h>
+#include "CTBotDefines.h"
+
+// the phases of a request to the Telegram server
+enum CTBotStatsPhase {
+	CTBotStatsConnect   = 0, // DNS lookup (when the cached address is expired), TCP connection and TLS handshake
+	CTBotStatsWrite     = 1, // request line, headers and body sent
+	CTBotStatsFirstByte = 2, // from the request sent to the first byte of the response
+	CTBotStatsRead      = 3, // from the first byte to the end of the response (headers and body)
+	CTBotStatsParse     = 4, // JSON deserialization (includes the body read when parsed straight from the connection)
+	CTBotStatsExtract   = 5, // received updates copied into TBMessage/TBMessageView
+	CTBotStatsPhaseCount
+};
+
+// the causes of a failed request
+enum CTBotStatsError {
+	CTBotStatsErrorConnect  = 0, // unable to connect to the Telegram server
+	CTBotStatsErrorTimeout  = 1, // no response or connection dropped while reading it
+	CTBotStatsErrorHTTP     = 2, // invalid HTTP response or status code other than 200
+	CTBotStatsErrorJSON     = 3, // JSON deserialization failed (i.e. document too small)
+	CTBotStatsErrorServer   = 4, // the Telegram server answered "ok": false
+	CTBotStatsErrorRefused  = 5, // not sent: the circuit breaker is open or the WiFi is not connected
+	CTBotStatsErrorCount
+};
+
+// timing of a phase, in microseconds
+struct CTBotStatsTiming {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;  // average = total / count
+	// the samples shorter than 256us, 1ms, 4ms, 16ms, 64ms, 256ms, 1s and the longer ones
+	uint32_t histogram[CTBOT_STATS_HISTOGRAM_SIZE];
+};
+
+// statistics of the requests sent to the Telegram server. See CTBot::getStats()
+struct CTBotStats {
+	CTBotStatsTiming phases[CTBotStatsPhaseCount];
+	uint32_t         errors[CTBotStatsErrorCount];
+	uint32_t         requests;      // HTTP requests sent
+	uint32_t         bytesSent;
+	uint32_t         bytesReceived;
+	uint32_t         heapLowWater;  // min free heap seen at the end of every phase
+
+	// clear all the statistics
+	void reset(void);
+
+	// add a sample to the timing of a phase
+	// params
+	//   phase  : the phase
+	//   elapsed: the duration of the phase, in microseconds
+	void record(CTBotStatsPhase phase, uint32_t elapsed);
+};
+
+// instrumentation helpers: they expand to nothing when CTBOT_ENABLE_STATS is zero
+#if CTBOT_ENABLE_STATS > 0
+#define CTBOT_STATS_START(mark)                uint32_t mark = micros()
+#define CTBOT_STATS_MARK(mark)                 (mark) = micros()
+#define CTBOT_STATS_RECORD(stats, phase, mark) (stats).record((phase), micros() - (mark))
+#define CTBOT_STATS_ERROR(stats, cause)        (stats).errors[(cause)]++
+#define CTBOT_STATS_ADD(stats, field, value)   (stats).field += (value)
+#else
+#define CTBOT_STATS_START(mark)
+#define CTBOT_STATS_MARK(mark)                 ((void)0)
+#define CTBOT_STATS_RECORD(stats, phase, mark) ((void)0)
+#define CTBOT_STATS_ERROR(stats, cause)        ((void)0)
+#define CTBOT_STATS_ADD(stats, field, value)   ((void)0)
+#endif
+
+#endif
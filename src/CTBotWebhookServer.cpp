@@ -0,0 +1,297 @@
+#include "CTBotWebhookServer.h"
+#include "Utilities.h"
+
+#if defined(ARDUINO_ARCH_ESP8266) && defined(__has_include)
+#if __has_include(<core_version.h>)
+#include <core_version.h> // ARDUINO_ESP8266_MAJOR
+#endif
+#endif
+
+// the header of the secret token passed to setWebhook
+static const char secretTokenHeader[] = "X-Telegram-Bot-Api-Secret-Token:";
+constexpr uint16_t READ_BUFFER_SIZE = 128; // bulk read size of the request body
+
+void CTBotRequestStream::begin(Client* client, int32_t length)
+{
+	m_client      = client;
+	m_contentLeft = length;
+	setTimeout(CTBOT_WEBHOOK_TIMEOUT);
+}
+
+void CTBotRequestStream::discard()
+{
+	char buffer[CTBOT_STREAM_BUFFER_SIZE];
+	while ((m_contentLeft > 0) && (readBytes(buffer, sizeof(buffer)) > 0));
+	m_contentLeft = 0;
+}
+
+int32_t CTBotRequestStream::getContentLeft() const
+{	return m_contentLeft;}
+
+size_t CTBotRequestStream::readBytes(char* buffer, size_t length)
+{
+	if ((NULL == m_client) || (m_contentLeft <= 0))
+		return 0;
+	if (length > (size_t)m_contentLeft)
+		length = m_contentLeft;
+
+	size_t count = 0;
+	uint32_t start = millis();
+	while (count < length) {
+		int32_t available = m_client->available();
+		if (available <= 0) {
+			if (!m_client->connected() || (millis() - start > CTBOT_WEBHOOK_TIMEOUT))
+				break;
+			delay(1);
+			continue;
+		}
+		if ((size_t)available > length - count)
+			available = length - count;
+		int32_t read = m_client->read((uint8_t*)buffer + count, available);
+		if (read <= 0)
+			break;
+		count += read;
+		m_contentLeft -= read;
+		start = millis();
+	}
+	return count;
+}
+
+int CTBotRequestStream::available()
+{
+	if ((NULL == m_client) || (m_contentLeft <= 0))
+		return 0;
+	int32_t length = m_client->available();
+	return (length < m_contentLeft) ? length : m_contentLeft;
+}
+
+int CTBotRequestStream::read()
+{
+	if ((NULL == m_client) || (m_contentLeft <= 0))
+		return -1;
+	int c = m_client->read();
+	if (c >= 0)
+		m_contentLeft--;
+	return c;
+}
+
+int CTBotRequestStream::peek()
+{
+	if ((NULL == m_client) || (m_contentLeft <= 0))
+		return -1;
+	return m_client->peek();
+}
+
+size_t CTBotRequestStream::write(uint8_t)
+{	return 0;}
+
+CTBotWebhookServer::CTBotWebhookServer()
+{}
+
+CTBotWebhookServer::~CTBotWebhookServer()
+{	end();}
+
+void CTBotWebhookServer::begin(uint16_t port)
+{
+	end();
+	m_server = new WiFiServer(port);
+	m_server->begin();
+}
+
+void CTBotWebhookServer::end()
+{
+	if (NULL == m_server)
+		return;
+	releaseRequest();
+	m_client.stop();
+	m_server->stop();
+	delete m_server;
+	m_server = NULL;
+}
+
+bool CTBotWebhookServer::isRunning() const
+{	return m_server != NULL;}
+
+bool CTBotWebhookServer::setSecretToken(const String& token)
+{
+	// the whole header line must fit the line buffer
+	if (token.length() + sizeof(secretTokenHeader) + 1 >= CTBOT_WEBHOOK_LINE_SIZE) {
+		serialLog("Webhook server: secret token too long\n");
+		return false;
+	}
+	m_secretToken = token;
+	return true;
+}
+
+Client* CTBotWebhookServer::accept()
+{
+	if (NULL == m_server)
+		return NULL;
+	// accept() replaced available() in the ESP32 core 2.0 and in the ESP8266 core 3.0
+#if (defined(ARDUINO_ARCH_ESP32) && defined(ESP_ARDUINO_VERSION_MAJOR) && (ESP_ARDUINO_VERSION_MAJOR >= 2)) || \
+	(defined(ARDUINO_ARCH_ESP8266) && defined(ARDUINO_ESP8266_MAJOR) && (ARDUINO_ESP8266_MAJOR >= 3))
+	m_client = m_server->accept();
+#else
+	m_client = m_server->available();
+#endif
+	if (!m_client)
+		return NULL;
+	return &m_client;
+}
+
+int16_t CTBotWebhookServer::readLine(Client& client, char* buffer, uint16_t size)
+{
+	uint16_t length = 0;
+	uint32_t start = millis();
+	while (millis() - start <= CTBOT_WEBHOOK_TIMEOUT) {
+		if (!client.available()) {
+			if (!client.connected())
+				break;
+			delay(1);
+			continue;
+		}
+		int c = client.read();
+		if (c == '\n') {
+			// strip the trailing CR
+			if ((length > 0) && (buffer[length - 1] == '\r'))
+				length--;
+			buffer[length] = 0x00;
+			return length;
+		}
+		// lines longer than the buffer are truncated
+		if (length < size - 1)
+			buffer[length++] = (char)c;
+	}
+	return -1;
+}
+
+uint16_t CTBotWebhookServer::readRequest(Client& client)
+{
+	char line[CTBOT_WEBHOOK_LINE_SIZE];
+	int16_t length;
+	int32_t contentLength = -1;
+	bool isChunked = false;
+	bool isAuthorized = (0 == m_secretToken.length());
+
+	// nothing to discard until the headers are read
+	m_bodyStream.begin(&client, 0);
+
+	// request line, i.e. POST /webhook HTTP/1.1. The path is not checked: the secret token
+	// tells the Telegram server from anyone else
+	if (readLine(client, line, sizeof(line)) <= 0)
+		return 400;
+	bool isPost = (0 == strncmp(line, "POST ", 5));
+
+	// headers, until an empty line
+	while ((length = readLine(client, line, sizeof(line))) > 0) {
+		if (0 == strncasecmp(line, "Content-Length:", 15))
+			contentLength = atol(line + 15);
+		else if (0 == strncasecmp(line, "Transfer-Encoding:", 18))
+			isChunked = true;
+		else if (0 == strncasecmp(line, secretTokenHeader, sizeof(secretTokenHeader) - 1)) {
+			const char* token = line + sizeof(secretTokenHeader) - 1;
+			while ((' ' == *token) || ('\t' == *token))
+				token++;
+			isAuthorized = isAuthorized || (m_secretToken == token);
+		}
+	}
+	if (length < 0)
+		return 408;
+
+	// the body is discarded by endRequest() if not read
+	if (!isChunked && (contentLength > 0))
+		m_bodyStream.begin(&client, contentLength);
+
+	if (!isPost)
+		return 405;
+	if (!isAuthorized) {
+		serialLog("Webhook server: request without the secret token refused\n");
+		return 401;
+	}
+	// Telegram (and the reverse proxies) always send the Content-Length
+	if (isChunked || (contentLength <= 0))
+		return 411;
+	return 200;
+}
+
+Stream& CTBotWebhookServer::getBodyStream()
+{	return m_bodyStream;}
+
+bool CTBotWebhookServer::readBody(String& body)
+{
+	if (!body.reserve(body.length() + m_bodyStream.getContentLeft())) {
+		serialLog("Webhook server: out of memory\n");
+		return false;
+	}
+	char buffer[READ_BUFFER_SIZE + 1];
+	size_t length;
+	while ((length = m_bodyStream.readBytes(buffer, READ_BUFFER_SIZE)) > 0) {
+		buffer[length] = 0x00;
+		body += buffer;
+	}
+	return 0 == m_bodyStream.getContentLeft();
+}
+
+// the reason phrase of the status codes used by the webhook server
+static const char* getReasonPhrase(uint16_t status)
+{
+	switch (status) {
+	case 200: return "OK";
+	case 400: return "Bad Request";
+	case 401: return "Unauthorized";
+	case 405: return "Method Not Allowed";
+	case 408: return "Request Timeout";
+	case 411: return "Length Required";
+	case 503: return "Service Unavailable";
+	default:  return "Error";
+	}
+}
+
+void CTBotWebhookServer::endRequest(Client& client, uint16_t status, const String& body)
+{
+	// a connection closed with unread data is reset, and the answer could be lost
+	m_bodyStream.discard();
+
+	char response[128];
+	int length = snprintf(response, sizeof(response), "HTTP/1.1 %u %s\r\n%sContent-Length: %u\r\nConnection: close\r\n\r\n",
+		(unsigned int)status, getReasonPhrase(status), (body.length() != 0) ? "Content-Type: application/json\r\n" : "",
+		body.length());
+	client.write((const uint8_t*)response, length);
+	if (body.length() != 0)
+		client.write((const uint8_t*)body.c_str(), body.length());
+	client.flush();
+	client.stop();
+	m_bodyStream.begin(NULL, 0);
+}
+
+void CTBotWebhookServer::holdRequest(Client& client)
+{
+	m_bodyStream.discard();
+	m_heldClient = &client;
+	m_reply      = "";
+}
+
+bool CTBotWebhookServer::isRequestHeld() const
+{	return m_heldClient != NULL;}
+
+bool CTBotWebhookServer::canReply() const
+{	return (m_heldClient != NULL) && (0 == m_reply.length());}
+
+bool CTBotWebhookServer::setReply(const String& reply)
+{
+	if (!canReply())
+		return false;
+	m_reply = reply;
+	return true;
+}
+
+void CTBotWebhookServer::releaseRequest()
+{
+	if (NULL == m_heldClient)
+		return;
+	Client* client = m_heldClient;
+	m_heldClient = NULL;
+	endRequest(*client, 200, m_reply);
+	// the reply could be long: free it
+	m_reply = String();
+}
@@ -0,0 +1,159 @@
+#pragma once
+#ifndef CTBOTWEBHOOKSERVER
+#define CTBOTWEBHOOKSERVER
+
+#include <Arduino.h>
+#if defined(ARDUINO_ARCH_ESP8266) // ESP8266
+#include <ESP8266WiFi.h>
+#elif defined(ARDUINO_ARCH_ESP32) // ESP32
+#include <WiFi.h>
+#endif
+#include "CTBotDefines.h"
+
+// read-only Stream over the body of a webhook request: no more than Content-Length bytes are read,
+// so a JSON document can be deserialized straight from the connection
+class CTBotRequestStream : public Stream
+{
+public:
+	// start reading a new body
+	// params
+	//   client: the connection
+	//   length: the body length (Content-Length)
+	void begin(Client* client, int32_t length);
+
+	// discard the unread part of the body
+	void discard(void);
+
+	// get how many bytes of the body are still to read
+	// returns
+	//   the unread bytes
+	int32_t getContentLeft(void) const;
+
+	// read the body in bulk (not a byte at a time), waiting up to CTBOT_WEBHOOK_TIMEOUT for the data
+	// params
+	//   buffer: where to store the bytes
+	//   length: how many bytes to read
+	// returns
+	//   the number of bytes read (less than length if timeout or end of the body)
+	size_t readBytes(char* buffer, size_t length);
+	using Stream::readBytes;
+
+	int    available(void) override;
+	int    read(void) override;
+	int    peek(void) override;
+	size_t write(uint8_t) override;
+
+private:
+	Client* m_client{ NULL };
+	int32_t m_contentLeft{ 0 };
+};
+
+// a minimal HTTP server that receives the updates POSTed by the Telegram server (see CTBot::startWebhookServer()).
+// It serves plain HTTP: Telegram delivers the updates only through HTTPS, so the TLS must be
+// terminated by a reverse proxy that forwards the requests to the board.
+// Only one request at a time is handled; the answer always closes the connection
+class CTBotWebhookServer
+{
+public:
+	CTBotWebhookServer();
+	~CTBotWebhookServer();
+
+	// start listening for the webhook requests
+	// params
+	//   port: the TCP port
+	void begin(uint16_t port);
+
+	// stop listening for the webhook requests
+	void end(void);
+
+	// check if the server is listening
+	// returns
+	//   true if the server is listening
+	bool isRunning(void) const;
+
+	// set the secret token that every request must carry in the X-Telegram-Bot-Api-Secret-Token header
+	// (the one passed to setWebhook). The requests without it are refused (401)
+	// params
+	//   token: the secret token, empty -> no check
+	// returns
+	//   false if the token is too long (see CTBOT_WEBHOOK_LINE_SIZE)
+	bool setSecretToken(const String& token);
+
+	// get the first pending connection, if any. It never waits
+	// returns
+	//   the connection, NULL if no request is pending
+	Client* accept(void);
+
+	// read the request line and the headers of a webhook request. Only the POST requests
+	// with a Content-Length header (and the right secret token) are accepted
+	// params
+	//   client: the connection
+	// returns
+	//   the HTTP status code to answer: 200 -> the body can be read with getBodyStream()/readBody()
+	uint16_t readRequest(Client& client);
+
+	// get the stream of the current request body
+	// returns
+	//   the request body stream
+	Stream& getBodyStream(void);
+
+	// read the whole body of the current request
+	// params
+	//   body: where to store the body
+	// returns
+	//   false if timeout or out of memory
+	bool readBody(String& body);
+
+	// answer the current request and close the connection. The unread body is discarded
+	// params
+	//   client: the connection
+	//   status: the HTTP status code
+	//   body  : (optional) the JSON body of the answer
+	void endRequest(Client& client, uint16_t status, const String& body = "");
+
+	// keep the current request open after its body has been read: it is answered by releaseRequest(),
+	// so the answer can carry a reply (see setReply())
+	// params
+	//   client: the connection
+	void holdRequest(Client& client);
+
+	// check if a request is held open
+	// returns
+	//   true if a request is waiting for releaseRequest()
+	bool isRequestHeld(void) const;
+
+	// check if a request is held open and its reply has not been set yet
+	// returns
+	//   true if setReply() can be called
+	bool canReply(void) const;
+
+	// set the reply of the held request: a Bot API method call, executed by the Telegram server
+	// when it gets the answer. Only one reply per request
+	// params
+	//   reply: the method call in JSON, i.e. {"method":"sendMessage","chat_id":123,"text":"hi"}
+	// returns
+	//   false if no request is held or its reply has already been set
+	bool setReply(const String& reply);
+
+	// answer the held request (if any) with its reply (if any)
+	void releaseRequest(void);
+
+private:
+	WiFiServer*        m_server{ NULL };
+	WiFiClient         m_client;        // the connection returned by accept()
+	String             m_secretToken{};
+	CTBotRequestStream m_bodyStream;
+	Client*            m_heldClient{ NULL }; // the request held open by holdRequest()
+	String             m_reply{};            // the reply of the held request
+
+	// read a CRLF terminated line (request line or header)
+	// params
+	//   client: the connection
+	//   buffer: where to store the line (CRLF stripped, zero terminated)
+	//   size  : the size of the buffer. Longer lines are truncated
+	// returns
+	//   the length of the line, -1 if timeout
+	int16_t readLine(Client& client, char* buffer, uint16_t size);
+};
+
+#endif
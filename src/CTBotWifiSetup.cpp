@@ -12,6 +12,25 @@ void CTBotWifiSetup::setMaxConnectionRetries(uint8_t retries)
 	m_wifiConnectionTries = retries;
 }
 
+bool CTBotWifiSetup::reconnect()
+{
+	if (WiFi.status() == WL_CONNECTED) {
+		if (m_isReconnecting)
+			serialLog("\nWiFi reconnected\n");
+		m_isReconnecting = false;
+		return true;
+	}
+
+	// a reconnection in progress is not restarted
+	if (m_isReconnecting && (millis() - m_lastReconnect < CTBOT_WIFI_RECONNECT_INTERVAL))
+		return false;
+	serialLog("\nWiFi reconnecting\n");
+	WiFi.reconnect();
+	m_lastReconnect  = millis();
+	m_isReconnecting = true;
+	return false;
+}
+
 bool CTBotWifiSetup::setIP(String ip, String gateway, String subnetMask, String dns1, String dns2) const {
 	IPAddress IP, SN, GW, DNS1, DNS2;
 
@@ -34,8 +34,16 @@ public:
 	//   retries: how many times wifiConnect have to try to connect
 	void setMaxConnectionRetries(uint8_t retries);
 
+	// check the WiFi connection and, if dropped, ask the WiFi to reconnect to the last network.
+	// It never waits: the reconnection is requested at most every CTBOT_WIFI_RECONNECT_INTERVAL milliseconds
+	// returns
+	//   true if the WiFi is connected
+	bool reconnect(void);
+
 private:
-	uint8_t m_wifiConnectionTries{ 0 };
+	uint8_t  m_wifiConnectionTries{ 0 };
+	uint32_t m_lastReconnect{ 0 }; // when the last reconnection was requested (millis)
+	bool     m_isReconnecting{ false };
 	int8_t  m_statusPin{ CTBOT_DISABLE_STATUS_PIN }; // status pin is disabled by default
 };
 
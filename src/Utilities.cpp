@@ -1,52 +1,91 @@
 #include "Utilities.h"
 
-bool unicodeToUTF8(String unicode, String &utf8) {
-	uint32_t value = 0;
-	unicode.toUpperCase();
+// get the value of an hexadecimal digit
+// returns
+//   the digit value, 0xFF if not an hexadecimal digit
+static inline uint8_t hexDigitValue(char digit) {
+	if ((digit >= '0') && (digit <= '9'))
+		return digit - '0';
+	if ((digit >= 'A') && (digit <= 'F'))
+		return digit - 'A' + 10;
+	if ((digit >= 'a') && (digit <= 'f'))
+		return digit - 'a' + 10;
+	return 0xFF;
+}
 
-	if (unicode.length() < 3)
+// decode a single \uXXXX escape sequence
+// returns
+//   true if valid
+static bool decodeSingleEscape(const char* escape, uint16_t& value) {
+	if ((escape[0] != '\\') || ((escape[1] != 'u') && (escape[1] != 'U')))
 		return false;
+	value = 0;
+	for (uint8_t i = 2; i < 6; i++) {
+		uint8_t digit = hexDigitValue(escape[i]);
+		if (0xFF == digit)
+			return false;
+		value = (value << 4) | digit;
+	}
+	return true;
+}
 
-	if ((unicode[0] != '\\') || (unicode[1] != 'U'))
-		return false;
+uint8_t decodeUnicodeEscape(const char* escape, uint16_t length, uint32_t& value) {
+	uint16_t high, low;
+	if ((length < 6) || !decodeSingleEscape(escape, high))
+		return 0;
 
-	for (uint16_t i = 2; i < unicode.length(); i++) {
-		uint8_t digit = unicode[i];
-		if ((digit >= '0') && (digit <= '9'))
-			digit -= '0';
-		else if ((digit >= 'A') && (digit <= 'F'))
-			digit = (digit - 'A') + 10;
-		else
-			return false;
-		value += digit << (4 * (unicode.length() - (i + 1)));
+	// not a surrogate: a character of the Basic Multilingual Plane
+	if ((high < 0xD800) || (high > 0xDFFF)) {
+		value = high;
+		return 6;
 	}
 
-	char buffer[2];
-	buffer[1] = 0x00;
-	utf8 = "";
+	// a high surrogate must be followed by a low surrogate
+	if ((high > 0xDBFF) || (length < 12) || !decodeSingleEscape(escape + 6, low) || (low < 0xDC00) || (low > 0xDFFF))
+		return 0;
+	value = 0x10000 + (((uint32_t)(high - 0xD800) << 10) | (low - 0xDC00));
+	return 12;
+}
 
+uint8_t codePointToUTF8(uint32_t value, char* utf8) {
 	if (value < 0x80) {
-		buffer[0] = value & 0x7F;
-		utf8 = (String)buffer;
-		return true;
+		utf8[0] = value;
+		return 1;
 	}
-
-	byte maxValue = 0x20;
-	byte mask = 0xC0;
-
-	while (maxValue > 0x01) {
-		buffer[0] = (value & 0x3F) | 0x80;
-		utf8 = (String)buffer + utf8;
-		value = value >> 6;
-		if (value < maxValue) {
-			buffer[0] = (value & (maxValue - 1)) | mask;
-			utf8 = (String)buffer + utf8;
-			return true;
-		}
-		mask = mask + maxValue;
-		maxValue = maxValue >> 1;
+	if (value < 0x800) {
+		utf8[0] = 0xC0 | (value >> 6);
+		utf8[1] = 0x80 | (value & 0x3F);
+		return 2;
+	}
+	if (value < 0x10000) {
+		utf8[0] = 0xE0 | (value >> 12);
+		utf8[1] = 0x80 | ((value >> 6) & 0x3F);
+		utf8[2] = 0x80 | (value & 0x3F);
+		return 3;
 	}
-	return false;
+	if (value < 0x110000) {
+		utf8[0] = 0xF0 | (value >> 18);
+		utf8[1] = 0x80 | ((value >> 12) & 0x3F);
+		utf8[2] = 0x80 | ((value >> 6) & 0x3F);
+		utf8[3] = 0x80 | (value & 0x3F);
+		return 4;
+	}
+	return 0;
+}
+
+bool unicodeToUTF8(const String& unicode, String &utf8) {
+	uint32_t value;
+	char buffer[5];
+
+	if (decodeUnicodeEscape(unicode.c_str(), unicode.length(), value) != unicode.length())
+		return false;
+
+	uint8_t length = codePointToUTF8(value, buffer);
+	if (0 == length)
+		return false;
+	buffer[length] = 0x00;
+	utf8 = buffer;
+	return true;
 }
 
 String int64ToAscii(int64_t value) {
@@ -68,31 +107,108 @@ String int64ToAscii(int64_t value) {
 	return buffer;
 }
 
-String URLEncodeMessage(String message) {
-	String encodedMessage("");
+// URL encoding classification: 1 -> unreserved character (RFC 3986), sent as is
+//                                0 -> percent encoded
+static const uint8_t URL_UNRESERVED[256] PROGMEM = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x00
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, // 0x20
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, // 0x30
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1, // 0x50
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0, // 0x70
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x80
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x90
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xA0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xB0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xC0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xD0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xE0
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xF0
+};
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static inline bool isURLUnreserved(uint8_t value) {
+	return pgm_read_byte(&URL_UNRESERVED[value]) != 0;
+}
+
+size_t URLEncodedLength(const String& message) {
+	size_t length = 0;
+	for (uint16_t i = 0; i < message.length(); i++)
+		length += isURLUnreserved(message[i]) ? 1 : 3;
+	return length;
+}
+
+size_t URLEncodeMessage(const char* message, char* buffer, size_t size) {
+	size_t length = 0;
+	for (; *message != 0x00; message++) {
+		uint8_t value = *message;
+		if (isURLUnreserved(value)) {
+			if (length + 1 >= size)
+				return 0;
+			buffer[length++] = value;
+		}
+		else {
+			if (length + 3 >= size)
+				return 0;
+			buffer[length++] = '%';
+			buffer[length++] = HEX_DIGITS[value >> 4];
+			buffer[length++] = HEX_DIGITS[value & 0x0F];
+		}
+	}
+	buffer[length] = 0x00;
+	return length;
+}
+
+bool URLEncodeMessage(const String& message, String& encoded) {
+	// a single allocation for the whole encoded message
+	if (!encoded.reserve(encoded.length() + URLEncodedLength(message)))
+		return false;
+
 	char buffer[4];
 	buffer[0] = '%';
 	buffer[3] = 0x00;
-	uint16_t i;
-	for (i = 0; i < message.length(); i++) {
-		if (((message[i] >= 0x30) && (message[i] <= 0x39)) || // numbers
-			((message[i] >= 0x41) && (message[i] <= 0x5A)) || // caps letters
-			((message[i] >= 0x61) && (message[i] <= 0x7A)))   // letters
-			encodedMessage += (String)message[i];
+	for (uint16_t i = 0; i < message.length(); i++) {
+		uint8_t value = message[i];
+		if (isURLUnreserved(value))
+			encoded += (char)value;
 		else {
-			buffer[1] = message[i] >> 4;
-			if (buffer[1] <= 0x09)
-				buffer[1] += 0x30;
-			else
-				buffer[1] += 0x41 - 0x0A;
-			buffer[2] = message[i] & 0x0F;
-			if (buffer[2] <= 0x09)
-				buffer[2] += 0x30;
-			else
-				buffer[2] += 0x41 - 0x0A;
-
-			encodedMessage += (String)buffer;
+			buffer[1] = HEX_DIGITS[value >> 4];
+			buffer[2] = HEX_DIGITS[value & 0x0F];
+			encoded += buffer;
 		}
 	}
+	return true;
+}
+
+String URLEncodeMessage(const String& message) {
+	String encodedMessage;
+	URLEncodeMessage(message, encodedMessage);
 	return encodedMessage;
 }
+
+size_t URLEncodeMessage(const String& message, Print& output) {
+	uint8_t buffer[CTBOT_URLENCODE_CHUNK_SIZE];
+	uint8_t length = 0;
+	size_t written = 0;
+
+	for (uint16_t i = 0; i < message.length(); i++) {
+		// room for a whole percent encoded character
+		if (length + 3 > CTBOT_URLENCODE_CHUNK_SIZE) {
+			written += output.write(buffer, length);
+			length = 0;
+		}
+		uint8_t value = message[i];
+		if (isURLUnreserved(value))
+			buffer[length++] = value;
+		else {
+			buffer[length++] = '%';
+			buffer[length++] = HEX_DIGITS[value >> 4];
+			buffer[length++] = HEX_DIGITS[value & 0x0F];
+		}
+	}
+	if (length > 0)
+		written += output.write(buffer, length);
+	return written;
+}
@@ -6,11 +6,29 @@
 
 // convert an UNICODE coded string to a UTF8 coded string
 // params
-//   unicode: the UNICODE string to convert
+//   unicode: the UNICODE string to convert, i.e. \u00e8 or the surrogate pair \ud83d\ude00
 //   utf8   : the string result of UNICODE to UTF8 conversion 
 // returns
 //   true if no error occurred
-bool unicodeToUTF8(String unicode, String &utf8);
+bool unicodeToUTF8(const String& unicode, String &utf8);
+
+// decode a \uXXXX escape sequence. The characters outside the Basic Multilingual Plane
+// (i.e. emoji) are escaped with a surrogate pair \uXXXX\uXXXX, decoded as a single code point
+// params
+//   escape: the escape sequence
+//   length: how many characters are available
+//   value : the decoded code point
+// returns
+//   the number of decoded characters (6, 12 for a surrogate pair), zero if not a valid escape sequence
+uint8_t decodeUnicodeEscape(const char* escape, uint16_t length, uint32_t& value);
+
+// encode a code point as UTF8
+// params
+//   value: the code point
+//   utf8 : where to store the UTF8 sequence (at least 4 bytes, not null terminated)
+// returns
+//   the length of the UTF8 sequence (1 to 4 bytes), zero if not a valid code point
+uint8_t codePointToUTF8(uint32_t value, char* utf8);
 
 // convert an int64 value to an ASCII string
 // params
@@ -19,12 +37,47 @@ bool unicodeToUTF8(String unicode, String &utf8);
 //   the ASCII string of the converted value 
 String int64ToAscii(int64_t value);
 
-// encode an input string to a URL (URI) compliant string
+// encode an input string to a URL (URI) compliant string. Only the unreserved
+// characters (letters, digits and -._~) are not percent encoded
 // params
 //   message: the string to be encoded
 // returns
 //   the encoded string
-String URLEncodeMessage(String message);
+String URLEncodeMessage(const String& message);
+
+// append an URL encoded string to another string. The exact room needed is reserved
+// before encoding, so the destination string is reallocated only once
+// params
+//   message: the string to be encoded
+//   encoded: the string where the encoded message is appended
+// returns
+//   false if out of memory
+bool URLEncodeMessage(const String& message, String& encoded);
+
+// encode an input string to a URL (URI) compliant string into a caller supplied buffer
+// params
+//   message: the null terminated string to be encoded
+//   buffer : where to store the encoded (null terminated) string
+//   size   : the buffer size, terminator included
+// returns
+//   the length of the encoded string, zero if the buffer is too small
+size_t URLEncodeMessage(const char* message, char* buffer, size_t size);
+
+// write an URL encoded string straight to an output (i.e. the connection with the server),
+// in chunks of CTBOT_URLENCODE_CHUNK_SIZE bytes: the encoded string is never stored in memory
+// params
+//   message: the string to be encoded
+//   output : where to write the encoded string
+// returns
+//   the number of bytes written
+size_t URLEncodeMessage(const String& message, Print& output);
+
+// get the length of a string once URL encoded
+// params
+//   message: the string to be encoded
+// returns
+//   the length of the encoded string
+size_t URLEncodedLength(const String& message);
 
 // send data to the serial port. It work only if the CTBOT_DEBUG_MODE is enabled.
 // params